@@ -0,0 +1,250 @@
+#pragma once
+
+#include "threadpool.h"
+#include <SDL2/SDL_stdinc.h>
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <vector>
+
+const int QUAD_MAX_DEPTH = 20;          // Deeper than this bodies share a leaf
+const int QUAD_TASK_DEPTH = 2;          // Subtrees from this depth down are built as separate tasks
+const int BODIES_PER_FORCE_TASK = 256;
+
+struct QuadNode
+{
+    float massX, massY; // Center of mass
+    float mass;
+    float size;         // Side of the square
+    int firstChild;     // Four children from here, -1 for a leaf
+    int body;           // The body of a leaf holding exactly one, -1 otherwise
+};
+
+// A subtree left for later, when building the top of the tree in parallel
+struct QuadTask
+{
+    int node;
+    int begin, end;
+    float left, top, size;
+};
+
+// Barnes-Hut tree over point masses. Every rebuild starts over from the body
+// positions, partitioning an index list into quadrants top down. The top two
+// levels are split on the calling thread and the sixteen subtrees below them
+// are built on the pool, each into its own node list, then appended
+struct QuadTree
+{
+    std::vector<QuadNode> nodes;
+    std::vector<int> order;
+
+    void build(const float* x, const float* y, const float* mass, int count, ThreadPool& pool) {
+        nodes.clear();
+        if (count == 0) return;
+        this->x = x;
+        this->y = y;
+        this->mass = mass;
+
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+        for (int i = 0; i < count; i++) {
+            minX = SDL_min(minX, x[i]);
+            minY = SDL_min(minY, y[i]);
+            maxX = SDL_max(maxX, x[i]);
+            maxY = SDL_max(maxY, y[i]);
+        }
+        order.resize(count);
+        for (int i = 0; i < count; i++) order[i] = i;
+
+        tasks.clear();
+        nodes.emplace_back();
+        buildNode(nodes, 0, 0, count, minX, minY, SDL_max(SDL_max(maxX - minX, maxY - minY), 1e-3f), 0, true);
+        int topCount = (int)nodes.size();
+
+        subtrees.resize(tasks.size());
+        pool.parallelFor((int)tasks.size(), 1, [this](int begin, int end) {
+            for (int t = begin; t < end; t++) {
+                const QuadTask& task = tasks[t];
+                subtrees[t].clear();
+                subtrees[t].emplace_back();
+                buildNode(subtrees[t], 0, task.begin, task.end, task.left, task.top, task.size, QUAD_TASK_DEPTH, false);
+            }
+        });
+
+        // A subtree's root replaces its placeholder, the rest goes on the end
+        for (size_t t = 0; t < tasks.size(); t++) {
+            std::vector<QuadNode>& subtree = subtrees[t];
+            int offset = (int)nodes.size() - 1;
+            for (QuadNode& node : subtree) {
+                if (node.firstChild >= 0) node.firstChild += offset;
+            }
+            nodes[tasks[t].node] = subtree[0];
+            nodes.insert(nodes.end(), subtree.begin() + 1, subtree.end());
+        }
+
+        // Children of the top nodes always come after their parents
+        for (int i = topCount - 1; i >= 0; i--) {
+            if (nodes[i].firstChild >= 0) combineChildren(nodes, i);
+        }
+    }
+
+    // Acceleration on body from every other body for unit gravity. Nodes seen
+    // under a smaller angle than theta count as one mass at their center
+    void acceleration(int body, float theta, float softening, float& ax, float& ay) const {
+        ax = ay = 0.0f;
+        if (nodes.empty()) return;
+        float px = x[body], py = y[body];
+        float thetaSquared = theta * theta, softeningSquared = softening * softening;
+        int stack[4 * QUAD_MAX_DEPTH + 4];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const QuadNode& node = nodes[stack[--top]];
+            if (node.mass == 0.0f || node.body == body) continue;
+            float dx = node.massX - px, dy = node.massY - py;
+            float distanceSquared = dx * dx + dy * dy;
+            if (node.firstChild >= 0 && node.size * node.size >= thetaSquared * distanceSquared) {
+                for (int c = 0; c < 4; c++) stack[top++] = node.firstChild + c;
+                continue;
+            }
+            float inverse = 1.0f / sqrtf(distanceSquared + softeningSquared);
+            float strength = node.mass * inverse * inverse * inverse;
+            ax += strength * dx;
+            ay += strength * dy;
+        }
+    }
+
+private:
+    const float* x = NULL;
+    const float* y = NULL;
+    const float* mass = NULL;
+    std::vector<QuadTask> tasks;
+    std::vector<std::vector<QuadNode>> subtrees;
+
+    void buildNode(std::vector<QuadNode>& out, int index, int begin, int end, float left, float top, float size, int depth, bool deferSubtrees) {
+        if (deferSubtrees && depth == QUAD_TASK_DEPTH && end - begin > 1) {
+            tasks.push_back({ index, begin, end, left, top, size });
+            return;
+        }
+        QuadNode& node = out[index];
+        node.size = size;
+        node.firstChild = -1;
+        node.body = end - begin == 1 ? order[begin] : -1;
+        if (end - begin <= 1 || depth == QUAD_MAX_DEPTH) {
+            node.mass = node.massX = node.massY = 0.0f;
+            for (int i = begin; i < end; i++) {
+                int b = order[i];
+                node.mass += mass[b];
+                node.massX += mass[b] * x[b];
+                node.massY += mass[b] * y[b];
+            }
+            if (node.mass > 0.0f) {
+                node.massX /= node.mass;
+                node.massY /= node.mass;
+            }
+            return;
+        }
+
+        // Top half first, then each half split into left and right
+        float half = 0.5f * size, midX = left + half, midY = top + half;
+        int* first = order.data() + begin;
+        int* last = order.data() + end;
+        int* middle = std::partition(first, last, [this, midY](int b) { return y[b] < midY; });
+        int* topSplit = std::partition(first, middle, [this, midX](int b) { return x[b] < midX; });
+        int* bottomSplit = std::partition(middle, last, [this, midX](int b) { return x[b] < midX; });
+        int bounds[5] = { begin, (int)(topSplit - order.data()), (int)(middle - order.data()), (int)(bottomSplit - order.data()), end };
+
+        int firstChild = (int)out.size();
+        out[index].firstChild = firstChild;
+        out.resize(out.size() + 4);
+        for (int c = 0; c < 4; c++) {
+            buildNode(out, firstChild + c, bounds[c], bounds[c + 1], left + (c & 1) * half, top + (c >> 1) * half, half, depth + 1, deferSubtrees);
+        }
+        if (!deferSubtrees || depth + 1 > QUAD_TASK_DEPTH) combineChildren(out, index);
+    }
+
+    void combineChildren(std::vector<QuadNode>& out, int index) {
+        QuadNode& node = out[index];
+        node.mass = node.massX = node.massY = 0.0f;
+        for (int c = 0; c < 4; c++) {
+            const QuadNode& child = out[node.firstChild + c];
+            node.mass += child.mass;
+            node.massX += child.mass * child.massX;
+            node.massY += child.mass * child.massY;
+        }
+        if (node.mass > 0.0f) {
+            node.massX /= node.mass;
+            node.massY /= node.mass;
+        }
+    }
+};
+
+// Strengths are zero when off. Forces come out in Newtons for masses in kg
+// and positions in world units
+struct AttractorSettings
+{
+    float wellStrength = 0.0f;   // Pull of the cursor on one kg at one meter
+    float mutualStrength = 0.0f; // Gravitational constant between circles
+    float edgeStrength = 0.0f;   // Push on one kg right at a screen edge
+    float edgeRange = 2.0f;      // How far from an edge the push reaches
+    float theta = 0.5f;          // Barnes-Hut opening angle, 0 is the exact sum
+    float softening = 0.25f;     // Keeps forces finite when bodies get close
+};
+
+struct AttractorField
+{
+    AttractorSettings settings;
+    float width, height;         // Screen in world units
+    bool wellActive = false;
+    float wellX = 0.0f, wellY = 0.0f;
+    QuadTree tree;
+    ThreadPool pool;
+    std::vector<float> x, y, mass, forceX, forceY; // Bodies gathered for computeForces
+
+    void resize(int count) {
+        for (std::vector<float>* array : { &x, &y, &mass, &forceX, &forceY }) array->resize(count);
+    }
+
+    AttractorField(const AttractorSettings& settings, float width, float height, int threads)
+        : settings(settings), width(width), height(height), pool(threads) {}
+
+    bool enabled() const {
+        return settings.wellStrength != 0.0f || settings.mutualStrength != 0.0f || settings.edgeStrength != 0.0f;
+    }
+
+    // Writes the attractor force on every body into forceX and forceY
+    void computeForces(const float* x, const float* y, const float* mass, int count, float* forceX, float* forceY) {
+        bool mutual = settings.mutualStrength != 0.0f;
+        if (mutual) tree.build(x, y, mass, count, pool);
+        // In tree order neighbouring bodies walk mostly the same nodes
+        pool.parallelFor(count, BODIES_PER_FORCE_TASK, [=](int begin, int end) {
+            for (int k = begin; k < end; k++) {
+                int i = mutual ? tree.order[k] : k;
+                float ax = 0.0f, ay = 0.0f;
+                if (mutual) {
+                    tree.acceleration(i, settings.theta, settings.softening, ax, ay);
+                    ax *= settings.mutualStrength;
+                    ay *= settings.mutualStrength;
+                }
+                if (wellActive && settings.wellStrength != 0.0f) {
+                    float dx = wellX - x[i], dy = wellY - y[i];
+                    float inverse = 1.0f / sqrtf(dx * dx + dy * dy + settings.softening * settings.softening);
+                    float strength = settings.wellStrength * inverse * inverse * inverse;
+                    ax += strength * dx;
+                    ay += strength * dy;
+                }
+                if (settings.edgeStrength != 0.0f) {
+                    ax += edgePush(x[i]) - edgePush(width - x[i]);
+                    ay += edgePush(y[i]) - edgePush(height - y[i]);
+                }
+                forceX[i] = mass[i] * ax;
+                forceY[i] = mass[i] * ay;
+            }
+        });
+    }
+
+    // Grows quadratically from nothing at edgeRange to edgeStrength at the edge
+    float edgePush(float distance) const {
+        if (distance >= settings.edgeRange) return 0.0f;
+        float closeness = 1.0f - SDL_max(distance, 0.0f) / settings.edgeRange;
+        return settings.edgeStrength * closeness * closeness;
+    }
+};
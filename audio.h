@@ -0,0 +1,313 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_mixer.h>
+#include "simd.h"
+
+const int MAX_VOICES = 64;
+const int MAX_MODES = 256;
+const int MODES_PER_STRIKE = 4;
+const int MIX_BLOCK_FRAMES = 512;
+
+// A playing sample. Gain and pan are baked into two Q15 channel gains when the
+// voice is started, so mixing it is one multiply-add per output sample
+struct Voice
+{
+    const Sint16* samples;
+    Uint32 length; // In frames
+    Uint32 cursor;
+    Sint32 gainLeft;
+    Sint32 gainRight;
+};
+
+// A strike that still has to be turned into modes on the audio thread
+struct Strike
+{
+    float pan;
+    float radius;
+    float gain;
+};
+
+// Procedural impact sounds as a bank of exponentially damped sinusoids. Every
+// mode is a complex phasor rotated and shrunk by a constant each sample, which
+// is four multiplies per mode and maps directly onto SSE lanes. Modes are kept
+// packed in SoA arrays with everything past modeCount zeroed, so the last
+// partially filled group of four can be rendered without special casing
+struct ImpactSynth
+{
+    alignas(16) float real[MAX_MODES];
+    alignas(16) float imag[MAX_MODES];
+    alignas(16) float rotCos[MAX_MODES];
+    alignas(16) float rotSin[MAX_MODES];
+    alignas(16) float gainLeft[MAX_MODES];
+    alignas(16) float gainRight[MAX_MODES];
+    __m128 scratchLeft[MIX_BLOCK_FRAMES];
+    __m128 scratchRight[MIX_BLOCK_FRAMES];
+    int modeCount = 0;
+    float sampleRate = 44100.0f;
+
+    ImpactSynth() {
+        SDL_memset(real, 0, sizeof(real));
+        SDL_memset(imag, 0, sizeof(imag));
+        SDL_memset(rotCos, 0, sizeof(rotCos));
+        SDL_memset(rotSin, 0, sizeof(rotSin));
+        SDL_memset(gainLeft, 0, sizeof(gainLeft));
+        SDL_memset(gainRight, 0, sizeof(gainRight));
+    }
+
+    void addMode(float frequency, float decayTime, float amplitude, float left, float right) {
+        if (frequency >= sampleRate * 0.5f) return;
+        int slot = modeCount;
+        if (slot == MAX_MODES) {
+            // Replace the quietest mode
+            slot = 0;
+            float quietest = real[0] * real[0] + imag[0] * imag[0];
+            for (int i = 1; i < modeCount; i++) {
+                float energy = real[i] * real[i] + imag[i] * imag[i];
+                if (energy < quietest) { quietest = energy; slot = i; }
+            }
+        }
+        else modeCount++;
+
+        // Decays by 60 dB over decayTime
+        float damping = SDL_powf(0.001f, 1.0f / (decayTime * sampleRate));
+        float omega = 2.0f * float(M_PI) * frequency / sampleRate;
+        real[slot] = amplitude;
+        imag[slot] = 0.0f;
+        rotCos[slot] = damping * SDL_cosf(omega);
+        rotSin[slot] = damping * SDL_sinf(omega);
+        gainLeft[slot] = left;
+        gainRight[slot] = right;
+    }
+
+    // Bigger circles sound lower and ring longer
+    void strike(const Strike& strike, float masterGain) {
+        static const float ratios[MODES_PER_STRIKE] = { 1.0f, 2.32f, 4.25f, 6.63f };
+        static const float amplitudes[MODES_PER_STRIKE] = { 1.0f, 0.5f, 0.25f, 0.12f };
+        float fundamental = 16000.0f / SDL_max(strike.radius, 1.0f);
+        float decay = 0.06f + 0.006f * strike.radius;
+        float angle = SDL_clamp(strike.pan, 0.0f, 1.0f) * float(M_PI) * 0.5f;
+        float gain = SDL_clamp(strike.gain, 0.0f, 1.0f) * masterGain * 0.5f;
+        for (int i = 0; i < MODES_PER_STRIKE; i++) {
+            addMode(fundamental * ratios[i], decay / ratios[i], amplitudes[i] * gain, SDL_cosf(angle), SDL_sinf(angle));
+        }
+    }
+
+    void render(Sint32* accumulator, int frames) {
+        if (modeCount == 0) return;
+        for (int i = 0; i < frames; i++) {
+            scratchLeft[i] = _mm_setzero_ps();
+            scratchRight[i] = _mm_setzero_ps();
+        }
+        for (int m = 0; m < modeCount; m += 4) {
+            __m128 re = _mm_load_ps(real + m);
+            __m128 im = _mm_load_ps(imag + m);
+            __m128 c = _mm_load_ps(rotCos + m);
+            __m128 s = _mm_load_ps(rotSin + m);
+            __m128 left = _mm_load_ps(gainLeft + m);
+            __m128 right = _mm_load_ps(gainRight + m);
+            for (int i = 0; i < frames; i++) {
+                __m128 nextRe = _mm_sub_ps(_mm_mul_ps(re, c), _mm_mul_ps(im, s));
+                im = _mm_add_ps(_mm_mul_ps(re, s), _mm_mul_ps(im, c));
+                re = nextRe;
+                scratchLeft[i] = _mm_add_ps(scratchLeft[i], _mm_mul_ps(im, left));
+                scratchRight[i] = _mm_add_ps(scratchRight[i], _mm_mul_ps(im, right));
+            }
+            _mm_store_ps(real + m, re);
+            _mm_store_ps(imag + m, im);
+        }
+        for (int i = 0; i < frames; i++) {
+            accumulator[i * 2] += (Sint32)(horizontalSum(scratchLeft[i]) * 32767.0f);
+            accumulator[i * 2 + 1] += (Sint32)(horizontalSum(scratchRight[i]) * 32767.0f);
+        }
+
+        // Drop modes that decayed below -80 dB, moving the last one into the gap
+        for (int m = 0; m < modeCount;) {
+            if (real[m] * real[m] + imag[m] * imag[m] > 1e-8f) { m++; continue; }
+            int last = --modeCount;
+            real[m] = real[last]; imag[m] = imag[last];
+            rotCos[m] = rotCos[last]; rotSin[m] = rotSin[last];
+            gainLeft[m] = gainLeft[last]; gainRight[m] = gainRight[last];
+            real[last] = imag[last] = rotCos[last] = rotSin[last] = gainLeft[last] = gainRight[last] = 0.0f;
+        }
+    }
+};
+
+// Mixes spatialized voices into SDL_mixer's music hook instead of using its
+// channels, so panning doesn't need a per-channel effect callback
+struct Mixer
+{
+    Voice voices[MAX_VOICES];
+    int voiceCount = 0;
+    Voice pending[MAX_VOICES];
+    int pendingCount = 0;
+    Strike pendingStrikes[MAX_VOICES];
+    int pendingStrikeCount = 0;
+    ImpactSynth synth;
+    SDL_SpinLock pendingLock = 0;
+    Sint32 accumulator[MIX_BLOCK_FRAMES * 2];
+    int channels = 2;
+    float masterGain = 0.25f;
+
+    // Without the device hook the owner drives mix() itself, e.g. for offline rendering
+    void open(bool hookDevice) {
+        int frequency;
+        Mix_QuerySpec(&frequency, NULL, &channels);
+        synth.sampleRate = (float)frequency;
+        if (hookDevice) Mix_HookMusic(callback, this);
+    }
+    void close() {
+        // Blocks until the audio thread has left the callback
+        Mix_HookMusic(NULL, NULL);
+    }
+
+    // Pan goes from 0 (left) to 1 (right), gain from 0 to 1
+    bool play(const Mix_Chunk* chunk, float pan, float gain) {
+        if (!chunk) return false;
+        pan = SDL_clamp(pan, 0.0f, 1.0f);
+        gain = SDL_clamp(gain, 0.0f, 1.0f) * masterGain;
+
+        // Constant power pan law, so a voice keeps its loudness across the screen
+        float angle = pan * float(M_PI) * 0.5f;
+        Voice voice;
+        voice.samples = (const Sint16*)chunk->abuf;
+        voice.length = chunk->alen / (sizeof(Sint16) * channels);
+        voice.cursor = 0;
+        voice.gainLeft = (Sint32)(SDL_cosf(angle) * gain * 32768.0f);
+        voice.gainRight = (Sint32)(SDL_sinf(angle) * gain * 32768.0f);
+
+        bool queued = false;
+        SDL_AtomicLock(&pendingLock);
+        if (pendingCount < MAX_VOICES) {
+            pending[pendingCount++] = voice;
+            queued = true;
+        }
+        SDL_AtomicUnlock(&pendingLock);
+        return queued;
+    }
+
+    // Synthesizes an impact instead of playing a sample, radius in pixels
+    bool strike(float pan, float radius, float gain) {
+        bool queued = false;
+        SDL_AtomicLock(&pendingLock);
+        if (pendingStrikeCount < MAX_VOICES) {
+            pendingStrikes[pendingStrikeCount++] = { pan, radius, gain };
+            queued = true;
+        }
+        SDL_AtomicUnlock(&pendingLock);
+        return queued;
+    }
+
+    void startPending() {
+        SDL_AtomicLock(&pendingLock);
+        for (int i = 0; i < pendingCount; i++) {
+            if (voiceCount < MAX_VOICES) {
+                voices[voiceCount++] = pending[i];
+                continue;
+            }
+            // Steal the voice that is closest to finishing
+            int steal = 0;
+            for (int j = 1; j < voiceCount; j++) {
+                if (voices[j].length - voices[j].cursor < voices[steal].length - voices[steal].cursor) steal = j;
+            }
+            voices[steal] = pending[i];
+        }
+        pendingCount = 0;
+        for (int i = 0; i < pendingStrikeCount; i++) synth.strike(pendingStrikes[i], masterGain);
+        pendingStrikeCount = 0;
+        SDL_AtomicUnlock(&pendingLock);
+    }
+
+    void mixBlock(Sint16* out, int frames) {
+        SDL_memset(accumulator, 0, sizeof(Sint32) * frames * 2);
+        for (int v = 0; v < voiceCount; v++) {
+            Voice& voice = voices[v];
+            int count = SDL_min((Uint32)frames, voice.length - voice.cursor);
+            Sint32 left = voice.gainLeft;
+            Sint32 right = voice.gainRight;
+
+            if (channels == 2) {
+                const Sint16* src = voice.samples + voice.cursor * 2;
+                for (int i = 0; i < count * 2; i += 2) {
+                    accumulator[i] += (src[i] * left) >> 15;
+                    accumulator[i + 1] += (src[i + 1] * right) >> 15;
+                }
+            }
+            else {
+                // Only the first two device channels get the voice, a mono
+                // device has no stereo image so only the gain applies
+                int rightOffset = channels > 1 ? 1 : 0;
+                if (channels == 1) left = right = (left + right) >> 1;
+                const Sint16* src = voice.samples + voice.cursor * channels;
+                for (int i = 0; i < count; i++) {
+                    accumulator[i * 2] += (src[i * channels] * left) >> 15;
+                    accumulator[i * 2 + 1] += (src[i * channels + rightOffset] * right) >> 15;
+                }
+            }
+            voice.cursor += count;
+        }
+        synth.render(accumulator, frames);
+
+        // Drop finished voices by swapping in the last one
+        for (int v = 0; v < voiceCount;) {
+            if (voices[v].cursor >= voices[v].length) voices[v] = voices[--voiceCount];
+            else v++;
+        }
+
+        for (int i = 0; i < frames; i++) {
+            for (int c = 0; c < SDL_min(channels, 2); c++) {
+                Sint32 sample = out[i * channels + c] + accumulator[i * 2 + c];
+                out[i * channels + c] = (Sint16)SDL_clamp(sample, -32768, 32767);
+            }
+        }
+    }
+
+    void mix(Sint16* out, int frames) {
+        startPending();
+        while (frames > 0) {
+            int block = SDL_min(frames, MIX_BLOCK_FRAMES);
+            mixBlock(out, block);
+            out += block * channels;
+            frames -= block;
+        }
+    }
+
+    static void SDLCALL callback(void* udata, Uint8* stream, int len) {
+        Mixer* mixer = (Mixer*)udata;
+        mixer->mix((Sint16*)stream, len / (int)(sizeof(Sint16) * mixer->channels));
+    }
+};
+
+// Louder for harder hits and bigger circles, never fully silent
+inline float impactGain(float impulse, float maxImpulse, float radius, float maxRadius)
+{
+    float strength = SDL_min(impulse / maxImpulse, 1.0f);
+    float size = SDL_min(radius / maxRadius, 1.0f);
+    return (0.2f + 0.8f * strength) * (0.5f + 0.5f * size);
+}
+
+// Writes interleaved 16-bit PCM as a canonical RIFF WAVE file
+inline bool writeWav(const char* path, const Sint16* samples, int frames, int channels, int frequency)
+{
+    SDL_RWops* file = SDL_RWFromFile(path, "wb");
+    if (!file) return false;
+
+    Uint32 dataSize = (Uint32)frames * channels * sizeof(Sint16);
+    SDL_RWwrite(file, "RIFF", 1, 4);
+    SDL_WriteLE32(file, 36 + dataSize);
+    SDL_RWwrite(file, "WAVEfmt ", 1, 8);
+    SDL_WriteLE32(file, 16);
+    SDL_WriteLE16(file, 1); // PCM
+    SDL_WriteLE16(file, (Uint16)channels);
+    SDL_WriteLE32(file, (Uint32)frequency);
+    SDL_WriteLE32(file, (Uint32)frequency * channels * sizeof(Sint16));
+    SDL_WriteLE16(file, (Uint16)(channels * sizeof(Sint16)));
+    SDL_WriteLE16(file, 16);
+    SDL_RWwrite(file, "data", 1, 4);
+    SDL_WriteLE32(file, dataSize);
+
+    // Samples are already little endian on the x64 targets we build for
+    size_t count = (size_t)frames * channels;
+    bool written = SDL_RWwrite(file, samples, sizeof(Sint16), count) == count;
+    return SDL_RWclose(file) == 0 && written;
+}
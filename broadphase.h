@@ -0,0 +1,90 @@
+#pragma once
+
+#include <SDL2/SDL_stdinc.h>
+#include <vector>
+
+// A broadphase for circles that all stay inside one rectangle. Cells are one
+// maximum diameter wide, so overlapping circles are always in the same or
+// neighbouring cells. Every rebuild counting sorts the bodies by cell and
+// copies their positions into that order, so the pair search walks memory
+// linearly instead of chasing an AABB tree
+struct UniformGrid
+{
+    float cellSize = 1.0f;
+    int columns = 1, rows = 1;
+    std::vector<int> cellStart;  // First sorted slot of each cell, one extra at the end
+    std::vector<int> sortedBody; // Body index of each sorted slot
+    std::vector<int> bodyCell;   // Cell of each body
+    std::vector<float> sortedX, sortedY, sortedRadius;
+
+    // Only needs to run again when a bigger circle shows up. The cells of the
+    // last rebuild no longer fit, so they are dropped
+    void configure(float width, float height, float maxRadius) {
+        cellStart.clear();
+        bodyCell.clear();
+        cellSize = SDL_max(2.0f * maxRadius, 1e-3f);
+        columns = SDL_max((int)(width / cellSize) + 1, 1);
+        rows = SDL_max((int)(height / cellSize) + 1, 1);
+    }
+
+    void rebuild(const float* x, const float* y, const float* radius, int count) {
+        int cells = columns * rows;
+        cellStart.assign(cells + 1, 0);
+        bodyCell.resize(count);
+        for (int i = 0; i < count; i++) {
+            int cx = SDL_clamp((int)(x[i] / cellSize), 0, columns - 1);
+            int cy = SDL_clamp((int)(y[i] / cellSize), 0, rows - 1);
+            bodyCell[i] = cy * columns + cx;
+            cellStart[bodyCell[i] + 1]++;
+        }
+        for (int c = 0; c < cells; c++) cellStart[c + 1] += cellStart[c];
+
+        sortedBody.resize(count);
+        sortedX.resize(count);
+        sortedY.resize(count);
+        sortedRadius.resize(count);
+        cursor.assign(cellStart.begin(), cellStart.end() - 1);
+        for (int i = 0; i < count; i++) {
+            int slot = cursor[bodyCell[i]]++;
+            sortedBody[slot] = i;
+            sortedX[slot] = x[i];
+            sortedY[slot] = y[i];
+            sortedRadius[slot] = radius[i];
+        }
+    }
+
+    // Calls onPair(a, b) once for every pair of overlapping circles. Each cell
+    // is only paired with itself and the four neighbours after it, so no pair
+    // is visited twice
+    template <typename Callback>
+    void findPairs(Callback&& onPair) const {
+        static const int offsets[4][2] = { { 1, 0 }, { -1, 1 }, { 0, 1 }, { 1, 1 } };
+        for (int cy = 0; cy < rows; cy++) {
+            for (int cx = 0; cx < columns; cx++) {
+                int cell = cy * columns + cx;
+                int begin = cellStart[cell], end = cellStart[cell + 1];
+                for (int i = begin; i < end; i++) {
+                    for (int j = i + 1; j < end; j++) testPair(i, j, onPair);
+                }
+                for (const int* offset : offsets) {
+                    int nx = cx + offset[0], ny = cy + offset[1];
+                    if (nx < 0 || nx >= columns || ny >= rows) continue;
+                    int neighbour = ny * columns + nx;
+                    for (int i = begin; i < end; i++) {
+                        for (int j = cellStart[neighbour]; j < cellStart[neighbour + 1]; j++) testPair(i, j, onPair);
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    std::vector<int> cursor;
+
+    template <typename Callback>
+    void testPair(int i, int j, Callback& onPair) const {
+        float dx = sortedX[j] - sortedX[i], dy = sortedY[j] - sortedY[i];
+        float reach = sortedRadius[i] + sortedRadius[j];
+        if (dx * dx + dy * dy < reach * reach) onPair(sortedBody[i], sortedBody[j]);
+    }
+};
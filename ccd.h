@@ -0,0 +1,79 @@
+#pragma once
+
+#include "physics.h"
+#include <SDL2/SDL.h>
+#include <vector>
+
+enum ContinuousMode
+{
+    CCD_OFF,
+    CCD_ALWAYS,   // Box2D's default, every body against the walls every step
+    CCD_ADAPTIVE, // Only while something moves fast enough to tunnel
+};
+
+// Decides before every step which bodies need continuous collision. A body is
+// fast when the next step moves it further than radiusFraction of its radius,
+// far enough to skip through something thin. Fast bodies become bullets, which
+// also stops them passing through other circles, and the world only runs its
+// time of impact phase while there is at least one. Box2D 2.4 has no per body
+// switch for the walls, that phase always takes every body along.
+// Circles that ended up fully outside the screen are counted as tunneled
+struct ContinuousPolicy
+{
+    ContinuousMode mode;
+    float radiusFraction;
+    float width, height; // Screen in world units
+    std::vector<Uint8> bullets, escaped;
+
+    Uint64 steps = 0, continuousSteps = 0, bulletSteps = 0, tunneled = 0;
+
+    ContinuousPolicy(ContinuousMode mode, float radiusFraction, float width, float height)
+        : mode(mode), radiusFraction(radiusFraction), width(width), height(height) {}
+
+    // Bodies 0 to count - 1, in the order the world created them
+    void update(PhysicsWorld& world, int count, float deltaTime) {
+        steps++;
+        bullets.resize(count, 0);
+        escaped.resize(count, 0);
+        if (mode != CCD_ADAPTIVE) {
+            world.setContinuousPhysics(mode == CCD_ALWAYS);
+            if (mode == CCD_ALWAYS) continuousSteps++;
+            return;
+        }
+
+        int fast = 0;
+        for (int i = 0; i < count; i++) {
+            BodyState state = world.getState(i);
+            float reach = radiusFraction * world.getRadius(i);
+            Uint8 bullet = state.awake && state.velocity.LengthSquared() * deltaTime * deltaTime > reach * reach;
+            fast += bullet;
+            if (bullet == bullets[i]) continue;
+            bullets[i] = bullet;
+            world.setBullet(i, bullet != 0);
+        }
+        world.setContinuousPhysics(fast > 0);
+        bulletSteps += fast;
+        if (fast > 0) continuousSteps++;
+    }
+
+    // After the step, counts each body only the first time it gets out
+    void checkEscapes(const PhysicsWorld& world, int count) {
+        escaped.resize(count, 0);
+        for (int i = 0; i < count; i++) {
+            if (escaped[i]) continue;
+            b2Vec2 position = world.getPosition(i);
+            float r = world.getRadius(i);
+            if (position.x < -r || position.y < -r || position.x > width + r || position.y > height + r) {
+                escaped[i] = 1;
+                tunneled++;
+            }
+        }
+    }
+
+    void logStats(const PhysicsWorld& world) const {
+        if (steps == 0) return;
+        SDL_Log("Continuous collision: on for %.1f%% of %llu steps, %.2f bullets per step, %.1f TOI contact updates and %.3f ms of TOI per step, %llu circles tunneled out",
+            100.0 * continuousSteps / steps, (unsigned long long)steps, (double)bulletSteps / steps,
+            (double)world.toiUpdates / steps, world.toiMs / steps, (unsigned long long)tunneled);
+    }
+};
@@ -0,0 +1,643 @@
+#pragma once
+
+#include "broadphase.h"
+#include "physics.h"
+#include "threadpool.h"
+#include <SDL2/SDL_stdinc.h>
+#include <emmintrin.h>
+#include <float.h>
+#include <math.h>
+
+// Box2D's tuning, so both engines settle the same way
+const float LINEAR_SLOP = 0.005f;
+const float BAUMGARTE = 0.2f;
+const float MAX_LINEAR_CORRECTION = 0.2f;
+const float VELOCITY_THRESHOLD = 1.0f;
+const float MAX_TRANSLATION = 2.0f;
+const float MAX_ROTATION = 0.5f * float(M_PI);
+const int SOLVER_WIDTH = 4;
+const int MAX_COLORS = 64;               // Colors tracked in a body's bit mask
+const int OVERFLOW_COLOR = MAX_COLORS;   // Contacts no color fits, solved on one thread
+const int BATCHES_PER_TASK = 32;
+const int BODIES_PER_TASK = 512;
+const float LOD_WAKE_OVERLAP = 0.05f;    // Idle circles overlapping deeper than this are woken to separate
+
+// A contact between two circles, or a wall and a circle. The wall is the
+// static body A. Normal points from A to B, and because the contact point of
+// two circles lies on the line between their centers, the lever arms are
+// just distances along it. Screen walls and the sides and corners of
+// obstacles are all half planes, whose points p satisfy normal · p = offset
+struct CircleContact
+{
+    int a, b;
+    float normalX, normalY;
+    float leverA, leverB;
+    float friction;
+    float offset;
+};
+
+// Four contacts that share no dynamic body, solved together in SSE lanes
+struct ContactBatch
+{
+    int a[SOLVER_WIDTH], b[SOLVER_WIDTH];
+    float normalX[SOLVER_WIDTH], normalY[SOLVER_WIDTH];
+    float leverA[SOLVER_WIDTH], leverB[SOLVER_WIDTH];
+    float normalMass[SOLVER_WIDTH], tangentMass[SOLVER_WIDTH];
+    float bias[SOLVER_WIDTH], friction[SOLVER_WIDTH];
+    float normalImpulse[SOLVER_WIDTH], tangentImpulse[SOLVER_WIDTH];
+    int lanes;
+};
+
+inline __m128 gather(const std::vector<float>& values, const int* index)
+{
+    return _mm_setr_ps(values[index[0]], values[index[1]], values[index[2]], values[index[3]]);
+}
+
+// Never writes the static body, every batch of a color shares it and its
+// velocity has to stay zero anyway
+inline void scatter(std::vector<float>& values, const int* index, __m128 lanes, int staticBody)
+{
+    float out[SOLVER_WIDTH];
+    _mm_storeu_ps(out, lanes);
+    for (int i = 0; i < SOLVER_WIDTH; i++) {
+        if (index[i] != staticBody) values[index[i]] = out[i];
+    }
+}
+
+// A physics engine that only knows circles inside a box. Bodies live in SoA
+// arrays, contacts come from the uniform grid, and the velocity solver is
+// Box2D's sequential impulse method run on batches of four independent
+// contacts at a time. There is one extra body past the last circle with zero
+// mass and velocity that stands in for the walls and pads partially filled
+// batches.
+// Contacts are graph colored so no two contacts of a color share a dynamic
+// body. Colors are solved one after another and the batches of one color are
+// spread over the thread pool. Which thread solves a batch can't change what
+// it computes, so a step gives the same bits with one thread or sixteen
+struct CircleWorld : PhysicsWorld
+{
+    float width, height; // In world units
+    int count = 0;
+    std::vector<float> posX, posY, angle;
+    std::vector<float> velX, velY, angVel;
+    std::vector<float> forceX, forceY;
+    std::vector<float> radius, invMass, invInertia;
+    std::vector<float> solverInvMass, solverInvInertia; // Zero for bodies sitting the step out
+    std::vector<Uint16> category;
+    std::vector<Uint8> tier;     // A LodTier
+    std::vector<Uint8> stepsDue; // Steps a body moves by in this one, zero when it sits out
+    int stepCount = 0;
+    Uint64 wakes = 0;
+
+    std::vector<b2AABB> obstacles;
+    std::vector<Uint8> obstacleLive;
+    std::vector<int> freeObstacles;
+    std::vector<int> found;
+
+    UniformGrid grid;
+    float maxRadius = 0.0f;
+    std::vector<CircleContact> contacts, sortedContacts;
+    std::vector<ContactBatch> batches;
+    std::vector<Uint64> bodyColors;  // Colors already used by each body's contacts
+    std::vector<int> contactColor;
+    int contactStart[OVERFLOW_COLOR + 2]; // Contacts are sorted by color
+    int batchStart[OVERFLOW_COLOR + 2];
+    ThreadPool pool;
+
+    CircleWorld(float width, float height, int threads = 1)
+        : width(width / PIXELS_PER_METER), height(height / PIXELS_PER_METER), pool(threads) {
+        resize(1);
+    }
+
+    void resize(int bodies) {
+        for (std::vector<float>* array : { &posX, &posY, &angle, &velX, &velY, &angVel, &forceX, &forceY, &radius, &invMass, &invInertia, &solverInvMass, &solverInvInertia }) {
+            array->resize(bodies, 0.0f);
+        }
+        category.resize(bodies, CATEGORY_CIRCLE);
+        tier.resize(bodies, LOD_FULL);
+        stepsDue.resize(bodies, 0);
+    }
+
+    void reserve(int bodies) override {
+        for (std::vector<float>* array : { &posX, &posY, &angle, &velX, &velY, &angVel, &forceX, &forceY, &radius, &invMass, &invInertia, &solverInvMass, &solverInvInertia }) {
+            array->reserve(bodies + 1);
+        }
+        category.reserve(bodies + 1);
+        tier.reserve(bodies + 1);
+        stepsDue.reserve(bodies + 1);
+    }
+
+    int createCircle(b2Vec2 position, float r, Uint16 bodyCategory) override {
+        // The new circle takes over the static slot, which moves one further
+        int body = count++;
+        resize(count + 1);
+        float mass = CIRCLE_DENSITY * float(M_PI) * r * r;
+        posX[body] = position.x;
+        posY[body] = position.y;
+        radius[body] = r;
+        category[body] = bodyCategory;
+        invMass[body] = 1.0f / mass;
+        invInertia[body] = 1.0f / (0.5f * mass * r * r);
+        if (r > maxRadius) {
+            maxRadius = r;
+            grid.configure(width, height, maxRadius);
+        }
+        return body;
+    }
+    // Forces and impulses wake a frozen body like they do in Box2D
+    void applyForce(int body, b2Vec2 force) override {
+        if (tier[body] == LOD_FROZEN) tier[body] = LOD_FULL;
+        forceX[body] += force.x;
+        forceY[body] += force.y;
+    }
+    void applyImpulse(int body, b2Vec2 impulse) override {
+        if (tier[body] == LOD_FROZEN) tier[body] = LOD_FULL;
+        velX[body] += invMass[body] * impulse.x;
+        velY[body] += invMass[body] * impulse.y;
+    }
+    b2Vec2 getPosition(int body) const override {
+        return b2Vec2(posX[body], posY[body]);
+    }
+    float getMass(int body) const override {
+        return 1.0f / invMass[body];
+    }
+    float getAngle(int body) const override {
+        return angle[body];
+    }
+    float getRadius(int body) const override {
+        return radius[body];
+    }
+    BodyState getState(int body) const override {
+        return { b2Vec2(posX[body], posY[body]), angle[body], b2Vec2(velX[body], velY[body]), angVel[body], tier[body] != LOD_FROZEN };
+    }
+    void setState(int body, const BodyState& state) override {
+        posX[body] = state.position.x;
+        posY[body] = state.position.y;
+        angle[body] = state.angle;
+        velX[body] = state.velocity.x;
+        velY[body] = state.velocity.y;
+        angVel[body] = state.angularVelocity;
+        if (!state.awake) setLod(body, LOD_FROZEN);
+        else if (tier[body] == LOD_FROZEN) tier[body] = LOD_FULL;
+    }
+    void setLod(int body, LodTier lod) override {
+        // Box2D drops the velocity and forces of a body it puts to sleep too
+        if (lod == LOD_FROZEN) velX[body] = velY[body] = angVel[body] = forceX[body] = forceY[body] = 0.0f;
+        tier[body] = lod;
+    }
+    // The walls are half planes, so nothing gets out of the screen however
+    // fast it goes. Circles can still pass through each other
+    void setContinuousPhysics(bool) override {}
+    void setBullet(int, bool) override {}
+
+    int createObstacle(const b2AABB& box) override {
+        int slotCount = (int)obstacles.size();
+        int obstacle = claimSlot(freeObstacles, slotCount);
+        obstacles.resize(slotCount);
+        obstacleLive.resize(slotCount, 0);
+        obstacles[obstacle] = box;
+        obstacleLive[obstacle] = 1;
+        wakeAround(box);
+        return obstacle;
+    }
+    void moveObstacle(int obstacle, const b2AABB& box) override {
+        wakeAround(obstacles[obstacle]);
+        obstacles[obstacle] = box;
+        wakeAround(box);
+    }
+    void destroyObstacle(int obstacle) override {
+        obstacleLive[obstacle] = 0;
+        freeObstacles.push_back(obstacle);
+        wakeAround(obstacles[obstacle]);
+    }
+    // The grid is rebuilt from scratch every sub-step, nothing to degrade
+    BroadphaseStats getBroadphaseStats() const override {
+        return { 0, 0, 0.0f, count };
+    }
+    void rebuildBroadphase() override {}
+    // In the colors b2World::DebugDraw uses. The screen walls are the screen
+    // edges, only obstacles are drawn
+    void debugDraw(b2Draw& draw) override {
+        Uint32 flags = draw.GetFlags();
+        b2Vec2 corners[4];
+        if (flags & b2Draw::e_shapeBit) {
+            for (int i = 0; i < count; i++) {
+                b2Color color = tier[i] == LOD_FROZEN ? b2Color(0.6f, 0.6f, 0.6f) : tier[i] == LOD_REDUCED ? b2Color(0.5f, 0.5f, 0.9f) : b2Color(0.9f, 0.7f, 0.7f);
+                draw.DrawSolidCircle(b2Vec2(posX[i], posY[i]), radius[i], b2Vec2(cosf(angle[i]), sinf(angle[i])), color);
+            }
+            for (size_t o = 0; o < obstacles.size(); o++) {
+                if (!obstacleLive[o]) continue;
+                boxCorners(obstacles[o], corners);
+                draw.DrawSolidPolygon(corners, 4, b2Color(0.5f, 0.9f, 0.5f));
+            }
+        }
+        if (flags & b2Draw::e_aabbBit) {
+            b2AABB box;
+            for (int i = 0; i < count; i++) {
+                box.lowerBound.Set(posX[i] - radius[i], posY[i] - radius[i]);
+                box.upperBound.Set(posX[i] + radius[i], posY[i] + radius[i]);
+                boxCorners(box, corners);
+                draw.DrawPolygon(corners, 4, b2Color(0.9f, 0.3f, 0.9f));
+            }
+        }
+        // Body B's contact point is leverB back along the normal
+        if (flags & b2Draw::e_pairBit) {
+            for (const CircleContact& c : contacts)
+                draw.DrawPoint(b2Vec2(posX[c.b] - c.normalX * c.leverB, posY[c.b] - c.normalY * c.leverB), CONTACT_POINT_SIZE, b2Color(1.0f, 0.9f, 0.2f));
+        }
+        if (flags & b2Draw::e_centerOfMassBit) {
+            for (int i = 0; i < count; i++) draw.DrawTransform(b2Transform(b2Vec2(posX[i], posY[i]), b2Rot(angle[i])));
+        }
+    }
+    static void boxCorners(const b2AABB& box, b2Vec2* corners) {
+        corners[0] = box.lowerBound;
+        corners[1].Set(box.upperBound.x, box.lowerBound.y);
+        corners[2] = box.upperBound;
+        corners[3].Set(box.lowerBound.x, box.upperBound.y);
+    }
+
+    // Frozen bodies skip their wall contacts, so a box moving onto one or
+    // away from under it has to wake it
+    void wakeAround(const b2AABB& box) {
+        found.clear();
+        queryAABB(widened(box, OBSTACLE_WAKE_MARGIN), found);
+        for (int body : found) {
+            if (tier[body] == LOD_FROZEN) tier[body] = LOD_FULL;
+        }
+    }
+
+    void step(float deltaTime) override {
+        if (deltaTime <= 0.0f || count == 0) return;
+
+        // Reduced bodies all take their turn on the same step, so they still
+        // push each other around. Bodies sitting a step out are static to the
+        // solver and keep their forces for their turn
+        bool reducedTurn = stepCount++ % LOD_REDUCED_INTERVAL == 0;
+        pool.parallelFor(count, BODIES_PER_TASK, [this, deltaTime, reducedTurn](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                stepsDue[i] = tier[i] == LOD_FULL ? 1 : tier[i] == LOD_REDUCED && reducedTurn ? LOD_REDUCED_INTERVAL : 0;
+                solverInvMass[i] = stepsDue[i] ? invMass[i] : 0.0f;
+                solverInvInertia[i] = stepsDue[i] ? invInertia[i] : 0.0f;
+                if (!stepsDue[i]) continue;
+                velX[i] += deltaTime * invMass[i] * forceX[i];
+                velY[i] += deltaTime * invMass[i] * forceY[i];
+                forceX[i] = forceY[i] = 0.0f;
+            }
+        });
+
+        // Forces went in once for the whole step, the sub-steps only split the solve
+        float subStep = deltaTime / subSteps;
+        for (int s = 0; s < subSteps; s++) {
+            findContacts();
+            buildBatches();
+            for (int i = 0; i < velocityIterations; i++) {
+                forEachColor(batchStart, BATCHES_PER_TASK, [this](int begin, int end) {
+                    for (int b = begin; b < end; b++) solveBatch(batches[b]);
+                });
+            }
+
+            pool.parallelFor(count, BODIES_PER_TASK, [this, subStep](int begin, int end) {
+                for (int i = begin; i < end; i++) {
+                    if (stepsDue[i]) integrate(i, subStep * stepsDue[i]);
+                }
+            });
+
+            for (int i = 0; i < positionIterations; i++) {
+                forEachColor(contactStart, BATCHES_PER_TASK * SOLVER_WIDTH, [this](int begin, int end) {
+                    for (int c = begin; c < end; c++) solvePosition(contacts[c]);
+                });
+            }
+        }
+    }
+
+    // Walks the grid cells under the box. The grid is from the start of the last
+    // sub-step, so the box is widened by the MAX_TRANSLATION a circle can have
+    // moved since plus a cell for the position corrections after it, and
+    // circles created after it are checked one by one
+    void queryAABB(const b2AABB& box, std::vector<int>& found) override {
+        int indexed = (int)grid.bodyCell.size();
+        if (indexed > 0) {
+            float margin = maxRadius + MAX_TRANSLATION + grid.cellSize;
+            int left = SDL_clamp((int)((box.lowerBound.x - margin) / grid.cellSize), 0, grid.columns - 1);
+            int right = SDL_clamp((int)((box.upperBound.x + margin) / grid.cellSize), 0, grid.columns - 1);
+            int top = SDL_clamp((int)((box.lowerBound.y - margin) / grid.cellSize), 0, grid.rows - 1);
+            int bottom = SDL_clamp((int)((box.upperBound.y + margin) / grid.cellSize), 0, grid.rows - 1);
+            for (int cy = top; cy <= bottom; cy++) {
+                for (int cx = left; cx <= right; cx++) {
+                    int cell = cy * grid.columns + cx;
+                    for (int slot = grid.cellStart[cell]; slot < grid.cellStart[cell + 1]; slot++) {
+                        int body = grid.sortedBody[slot];
+                        if (overlaps(body, box)) found.push_back(body);
+                    }
+                }
+            }
+        }
+        for (int i = indexed; i < count; i++) {
+            if (overlaps(i, box)) found.push_back(i);
+        }
+    }
+
+    bool overlaps(int body, const b2AABB& box) const {
+        float r = radius[body];
+        return posX[body] + r > box.lowerBound.x && posX[body] - r < box.upperBound.x &&
+               posY[body] + r > box.lowerBound.y && posY[body] - r < box.upperBound.y;
+    }
+
+    // Colors run in order, the items inside one color in parallel
+    void forEachColor(const int* start, int grain, const std::function<void(int, int)>& solve) {
+        for (int color = 0; color < OVERFLOW_COLOR; color++) {
+            int begin = start[color];
+            pool.parallelFor(start[color + 1] - begin, grain, [begin, &solve](int first, int last) { solve(begin + first, begin + last); });
+        }
+        solve(start[OVERFLOW_COLOR], start[OVERFLOW_COLOR + 1]);
+    }
+
+    void integrate(int i, float deltaTime) {
+        float dx = deltaTime * velX[i], dy = deltaTime * velY[i];
+        float translation = dx * dx + dy * dy;
+        if (translation > MAX_TRANSLATION * MAX_TRANSLATION) {
+            float scale = MAX_TRANSLATION / sqrtf(translation);
+            velX[i] *= scale;
+            velY[i] *= scale;
+        }
+        float rotation = deltaTime * angVel[i];
+        if (rotation * rotation > MAX_ROTATION * MAX_ROTATION) angVel[i] *= MAX_ROTATION / fabsf(rotation);
+
+        posX[i] += deltaTime * velX[i];
+        posY[i] += deltaTime * velY[i];
+        angle[i] += deltaTime * angVel[i];
+    }
+
+    void findContacts() {
+        contacts.clear();
+        grid.rebuild(posX.data(), posY.data(), radius.data(), count);
+        grid.findPairs([this](int a, int b) { addCircleContact(SDL_min(a, b), SDL_max(a, b)); });
+
+        int wall = count;
+        for (int i = 0; i < count; i++) {
+            if (!stepsDue[i] || !(collisionMask(category[i]) & CATEGORY_WALL)) continue;
+            float r = radius[i];
+            if (posX[i] - r < 0.0f) addWallContact(wall, i, 1.0f, 0.0f, 0.0f);
+            if (posX[i] + r > width) addWallContact(wall, i, -1.0f, 0.0f, -width);
+            if (posY[i] - r < 0.0f) addWallContact(wall, i, 0.0f, 1.0f, 0.0f);
+            if (posY[i] + r > height) addWallContact(wall, i, 0.0f, -1.0f, -height);
+        }
+        for (size_t o = 0; o < obstacles.size(); o++) {
+            if (obstacleLive[o]) findObstacleContacts(wall, obstacles[o]);
+        }
+    }
+
+    void addWallContact(int wall, int body, float normalX, float normalY, float offset) {
+        contacts.push_back({ wall, body, normalX, normalY, 0.0f, radius[body], sqrtf(CIRCLE_FRICTION * WALL_FRICTION), offset });
+    }
+
+    // Walks the grid cells under the box like queryAABB, but the grid was
+    // just rebuilt so the radius is margin enough. A circle outside
+    // touches the closest point of the box, one whose center got inside is
+    // pushed out through the nearest side
+    void findObstacleContacts(int wall, const b2AABB& box) {
+        float margin = maxRadius;
+        int left = SDL_clamp((int)((box.lowerBound.x - margin) / grid.cellSize), 0, grid.columns - 1);
+        int right = SDL_clamp((int)((box.upperBound.x + margin) / grid.cellSize), 0, grid.columns - 1);
+        int top = SDL_clamp((int)((box.lowerBound.y - margin) / grid.cellSize), 0, grid.rows - 1);
+        int bottom = SDL_clamp((int)((box.upperBound.y + margin) / grid.cellSize), 0, grid.rows - 1);
+        for (int cy = top; cy <= bottom; cy++) {
+            for (int cx = left; cx <= right; cx++) {
+                int cell = cy * grid.columns + cx;
+                for (int slot = grid.cellStart[cell]; slot < grid.cellStart[cell + 1]; slot++) {
+                    int i = grid.sortedBody[slot];
+                    if (!stepsDue[i] || !(collisionMask(category[i]) & CATEGORY_WALL) || !overlaps(i, box)) continue;
+                    float x = posX[i], y = posY[i];
+                    float closestX = SDL_clamp(x, box.lowerBound.x, box.upperBound.x);
+                    float closestY = SDL_clamp(y, box.lowerBound.y, box.upperBound.y);
+                    float dx = x - closestX, dy = y - closestY;
+                    float distanceSquared = dx * dx + dy * dy;
+                    if (distanceSquared > FLT_EPSILON) {
+                        if (distanceSquared >= radius[i] * radius[i]) continue;
+                        float distance = sqrtf(distanceSquared);
+                        float nx = dx / distance, ny = dy / distance;
+                        addWallContact(wall, i, nx, ny, nx * closestX + ny * closestY);
+                        continue;
+                    }
+                    float toLeft = x - box.lowerBound.x, toRight = box.upperBound.x - x;
+                    float toTop = y - box.lowerBound.y, toBottom = box.upperBound.y - y;
+                    float nearest = SDL_min(SDL_min(toLeft, toRight), SDL_min(toTop, toBottom));
+                    if (nearest == toLeft) addWallContact(wall, i, -1.0f, 0.0f, -box.lowerBound.x);
+                    else if (nearest == toRight) addWallContact(wall, i, 1.0f, 0.0f, box.upperBound.x);
+                    else if (nearest == toTop) addWallContact(wall, i, 0.0f, -1.0f, -box.lowerBound.y);
+                    else addWallContact(wall, i, 0.0f, 1.0f, box.upperBound.y);
+                }
+            }
+        }
+    }
+
+    void addCircleContact(int a, int b) {
+        if (!(collisionMask(category[a]) & category[b])) return;
+        float dx = posX[b] - posX[a], dy = posY[b] - posY[a];
+        float reach = radius[a] + radius[b];
+        float distanceSquared = dx * dx + dy * dy;
+        if (distanceSquared >= reach * reach) return;
+
+        // Two bodies sitting the step out are left alone unless they overlap
+        // too deep to be at rest
+        float distance = sqrtf(distanceSquared);
+        bool idle = !stepsDue[a] && !stepsDue[b];
+        if (idle && reach - distance < LOD_WAKE_OVERLAP) return;
+        float nx = 1.0f, ny = 0.0f;
+        if (distance > FLT_EPSILON) {
+            nx = dx / distance;
+            ny = dy / distance;
+        }
+        // Contact point halfway between the two surfaces
+        float leverA = 0.5f * (distance + radius[a] - radius[b]);
+        contacts.push_back({ a, b, nx, ny, leverA, distance - leverA, CIRCLE_FRICTION, 0.0f });
+
+        // A body sitting the step out would stop whatever hits it like a wall.
+        // Its contacts with other idle bodies show up from the next sub-step
+        float approach = (velX[b] - velX[a]) * nx + (velY[b] - velY[a]) * ny;
+        if (idle || approach < -LOD_WAKE_SPEED) {
+            if (!stepsDue[a]) wake(a);
+            if (!stepsDue[b]) wake(b);
+        }
+    }
+
+    void wake(int body) {
+        tier[body] = LOD_FULL;
+        stepsDue[body] = 1;
+        solverInvMass[body] = invMass[body];
+        solverInvInertia[body] = invInertia[body];
+        wakes++;
+    }
+
+    // Greedy coloring, each contact takes the lowest color neither of its
+    // bodies has used yet. The static body can be in every contact of a color.
+    // Contacts are then counting sorted by color and cut into batches, four
+    // per batch except in the overflow color where every contact is alone
+    void buildBatches() {
+        int wall = count;
+        bodyColors.assign(count + 1, 0);
+        contactColor.resize(contacts.size());
+        int colorSize[OVERFLOW_COLOR + 1] = {};
+        for (size_t i = 0; i < contacts.size(); i++) {
+            const CircleContact& c = contacts[i];
+            Uint64 used = (c.a == wall ? 0 : bodyColors[c.a]) | bodyColors[c.b];
+            int color = 0;
+            while (color < MAX_COLORS && (used & (1ull << color))) color++;
+            if (color < MAX_COLORS) {
+                if (c.a != wall) bodyColors[c.a] |= 1ull << color;
+                bodyColors[c.b] |= 1ull << color;
+            }
+            contactColor[i] = color;
+            colorSize[color]++;
+        }
+
+        contactStart[0] = batchStart[0] = 0;
+        for (int color = 0; color <= OVERFLOW_COLOR; color++) {
+            int lanes = color == OVERFLOW_COLOR ? 1 : SOLVER_WIDTH;
+            contactStart[color + 1] = contactStart[color] + colorSize[color];
+            batchStart[color + 1] = batchStart[color] + (colorSize[color] + lanes - 1) / lanes;
+        }
+        sortedContacts.resize(contacts.size());
+        int cursor[OVERFLOW_COLOR + 1];
+        SDL_memcpy(cursor, contactStart, sizeof(cursor));
+        for (size_t i = 0; i < contacts.size(); i++) sortedContacts[cursor[contactColor[i]]++] = contacts[i];
+        contacts.swap(sortedContacts);
+
+        batches.resize(batchStart[OVERFLOW_COLOR + 1]);
+        for (int color = 0; color <= OVERFLOW_COLOR; color++) {
+            int lanes = color == OVERFLOW_COLOR ? 1 : SOLVER_WIDTH;
+            int first = contactStart[color];
+            pool.parallelFor(batchStart[color + 1] - batchStart[color], BATCHES_PER_TASK, [=](int begin, int end) {
+                for (int b = begin; b < end; b++) {
+                    ContactBatch& batch = batches[batchStart[color] + b];
+                    int from = first + b * lanes;
+                    batch.lanes = SDL_min(lanes, contactStart[color + 1] - from);
+                    for (int lane = 0; lane < batch.lanes; lane++) prepareLane(batch, lane, contacts[from + lane]);
+                    padLanes(batch);
+                }
+            });
+        }
+    }
+
+    // Leftover lanes get a contact between the static body and itself
+    void padLanes(ContactBatch& batch) {
+        int wall = count;
+        for (int lane = batch.lanes; lane < SOLVER_WIDTH; lane++) {
+            batch.a[lane] = batch.b[lane] = wall;
+            batch.normalX[lane] = 1.0f;
+            batch.normalY[lane] = 0.0f;
+            batch.leverA[lane] = batch.leverB[lane] = 0.0f;
+            batch.normalMass[lane] = batch.tangentMass[lane] = 0.0f;
+            batch.bias[lane] = batch.friction[lane] = 0.0f;
+            batch.normalImpulse[lane] = batch.tangentImpulse[lane] = 0.0f;
+        }
+    }
+
+    void prepareLane(ContactBatch& batch, int lane, const CircleContact& c) {
+        float mA = solverInvMass[c.a], mB = solverInvMass[c.b];
+        float iA = solverInvInertia[c.a], iB = solverInvInertia[c.b];
+        batch.a[lane] = c.a;
+        batch.b[lane] = c.b;
+        batch.normalX[lane] = c.normalX;
+        batch.normalY[lane] = c.normalY;
+        batch.leverA[lane] = c.leverA;
+        batch.leverB[lane] = c.leverB;
+        batch.friction[lane] = c.friction;
+        batch.normalImpulse[lane] = batch.tangentImpulse[lane] = 0.0f;
+
+        // The lever arms are parallel to the normal, so only friction turns the circles
+        float normalK = mA + mB;
+        float tangentK = mA + mB + iA * c.leverA * c.leverA + iB * c.leverB * c.leverB;
+        batch.normalMass[lane] = normalK > 0.0f ? 1.0f / normalK : 0.0f;
+        batch.tangentMass[lane] = tangentK > 0.0f ? 1.0f / tangentK : 0.0f;
+
+        // Restitution only for real impacts, resting contacts would jitter
+        float approach = (velX[c.b] - velX[c.a]) * c.normalX + (velY[c.b] - velY[c.a]) * c.normalY;
+        batch.bias[lane] = approach < -VELOCITY_THRESHOLD ? -CIRCLE_RESTITUTION * approach : 0.0f;
+    }
+
+    void solveBatch(ContactBatch& batch) {
+        __m128 vAx = gather(velX, batch.a), vAy = gather(velY, batch.a), wA = gather(angVel, batch.a);
+        __m128 vBx = gather(velX, batch.b), vBy = gather(velY, batch.b), wB = gather(angVel, batch.b);
+        __m128 mA = gather(solverInvMass, batch.a), iA = gather(solverInvInertia, batch.a);
+        __m128 mB = gather(solverInvMass, batch.b), iB = gather(solverInvInertia, batch.b);
+        __m128 nx = _mm_loadu_ps(batch.normalX), ny = _mm_loadu_ps(batch.normalY);
+        __m128 leverA = _mm_loadu_ps(batch.leverA), leverB = _mm_loadu_ps(batch.leverB);
+        __m128 zero = _mm_setzero_ps();
+
+        // Friction first, tangent is the normal turned clockwise like b2Cross(n, 1)
+        {
+            __m128 tx = ny, ty = _mm_sub_ps(zero, nx);
+            __m128 dvx = _mm_sub_ps(vBx, vAx), dvy = _mm_sub_ps(vBy, vAy);
+            __m128 vt = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dvx, tx), _mm_mul_ps(dvy, ty)),
+                                   _mm_add_ps(_mm_mul_ps(wB, leverB), _mm_mul_ps(wA, leverA)));
+            __m128 lambda = _mm_mul_ps(_mm_loadu_ps(batch.tangentMass), _mm_sub_ps(zero, vt));
+            __m128 maxFriction = _mm_mul_ps(_mm_loadu_ps(batch.friction), _mm_loadu_ps(batch.normalImpulse));
+            __m128 old = _mm_loadu_ps(batch.tangentImpulse);
+            __m128 total = _mm_max_ps(_mm_sub_ps(zero, maxFriction), _mm_min_ps(_mm_add_ps(old, lambda), maxFriction));
+            _mm_storeu_ps(batch.tangentImpulse, total);
+            lambda = _mm_sub_ps(total, old);
+
+            __m128 px = _mm_mul_ps(lambda, tx), py = _mm_mul_ps(lambda, ty);
+            vAx = _mm_sub_ps(vAx, _mm_mul_ps(mA, px));
+            vAy = _mm_sub_ps(vAy, _mm_mul_ps(mA, py));
+            wA = _mm_add_ps(wA, _mm_mul_ps(iA, _mm_mul_ps(lambda, leverA)));
+            vBx = _mm_add_ps(vBx, _mm_mul_ps(mB, px));
+            vBy = _mm_add_ps(vBy, _mm_mul_ps(mB, py));
+            wB = _mm_add_ps(wB, _mm_mul_ps(iB, _mm_mul_ps(lambda, leverB)));
+        }
+
+        // Non-penetration with the restitution bias, accumulated impulse stays positive
+        {
+            __m128 dvx = _mm_sub_ps(vBx, vAx), dvy = _mm_sub_ps(vBy, vAy);
+            __m128 vn = _mm_add_ps(_mm_mul_ps(dvx, nx), _mm_mul_ps(dvy, ny));
+            __m128 lambda = _mm_mul_ps(_mm_loadu_ps(batch.normalMass), _mm_sub_ps(_mm_loadu_ps(batch.bias), vn));
+            __m128 old = _mm_loadu_ps(batch.normalImpulse);
+            __m128 total = _mm_max_ps(_mm_add_ps(old, lambda), zero);
+            _mm_storeu_ps(batch.normalImpulse, total);
+            lambda = _mm_sub_ps(total, old);
+
+            __m128 px = _mm_mul_ps(lambda, nx), py = _mm_mul_ps(lambda, ny);
+            vAx = _mm_sub_ps(vAx, _mm_mul_ps(mA, px));
+            vAy = _mm_sub_ps(vAy, _mm_mul_ps(mA, py));
+            vBx = _mm_add_ps(vBx, _mm_mul_ps(mB, px));
+            vBy = _mm_add_ps(vBy, _mm_mul_ps(mB, py));
+        }
+
+        int wall = count;
+        scatter(velX, batch.a, vAx, wall);
+        scatter(velY, batch.a, vAy, wall);
+        scatter(angVel, batch.a, wA, wall);
+        scatter(velX, batch.b, vBx, wall);
+        scatter(velY, batch.b, vBy, wall);
+        scatter(angVel, batch.b, wB, wall);
+    }
+
+    // Pushes overlapping circles apart like Box2D's position solver, with the
+    // separation recomputed from the integrated positions
+    void solvePosition(const CircleContact& c) {
+        int wall = count;
+        float nx = c.normalX, ny = c.normalY, separation;
+        if (c.a == wall) separation = nx * posX[c.b] + ny * posY[c.b] - c.offset - radius[c.b];
+        else {
+            float dx = posX[c.b] - posX[c.a], dy = posY[c.b] - posY[c.a];
+            float distance = sqrtf(dx * dx + dy * dy);
+            if (distance > FLT_EPSILON) {
+                nx = dx / distance;
+                ny = dy / distance;
+            }
+            separation = distance - radius[c.a] - radius[c.b];
+        }
+
+        float correction = SDL_clamp(BAUMGARTE * (separation + LINEAR_SLOP), -MAX_LINEAR_CORRECTION, 0.0f);
+        float mA = solverInvMass[c.a], mB = solverInvMass[c.b];
+        if (correction == 0.0f || mA + mB == 0.0f) return;
+        float impulse = -correction / (mA + mB);
+        if (c.a != wall) {
+            posX[c.a] -= mA * impulse * nx;
+            posY[c.a] -= mA * impulse * ny;
+        }
+        posX[c.b] += mB * impulse * nx;
+        posY[c.b] += mB * impulse * ny;
+    }
+};
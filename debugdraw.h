@@ -0,0 +1,106 @@
+#pragma once
+
+#include <SDL2/SDL_stdinc.h>
+#include <box2d/box2d.h>
+#include <math.h>
+#include <vector>
+
+const int DEBUG_CIRCLE_SEGMENTS = 12;
+const float DEBUG_FILL_ALPHA = 0.5f; // Solid shapes are filled see through
+const float DEBUG_AXIS_LENGTH = 0.4f; // World units, the cross at each center of mass
+
+struct DebugColor
+{
+    Uint8 red, green, blue, alpha;
+};
+
+struct DebugVertex
+{
+    float x, y; // World units
+    DebugColor color;
+};
+
+// Collects everything a debug draw reports into one triangle list and one
+// line list, so a frame of it costs two draw calls however much there is.
+// Solid shapes are filled triangles, outlines and segments are lines and
+// points are small squares. Colors are converted once per call, circles
+// come from a table of unit points and the lists keep their capacity
+// between frames, so collecting 10k bodies is a pass of plain stores
+struct DebugBatch : b2Draw
+{
+    std::vector<DebugVertex> triangles, lines;
+    b2Vec2 unitCircle[DEBUG_CIRCLE_SEGMENTS];
+    float metersPerPixel;
+
+    explicit DebugBatch(float pixelsPerMeter) : metersPerPixel(1.0f / pixelsPerMeter) {
+        for (int i = 0; i < DEBUG_CIRCLE_SEGMENTS; i++) {
+            float theta = 2.0f * b2_pi * i / DEBUG_CIRCLE_SEGMENTS;
+            unitCircle[i].Set(cosf(theta), sinf(theta));
+        }
+    }
+
+    void clear() {
+        triangles.clear();
+        lines.clear();
+    }
+
+    static DebugColor convert(const b2Color& color, float alpha = 1.0f) {
+        return { (Uint8)(color.r * 255), (Uint8)(color.g * 255), (Uint8)(color.b * 255), (Uint8)(color.a * alpha * 255) };
+    }
+    void line(const b2Vec2& a, const b2Vec2& b, DebugColor color) {
+        lines.push_back({ a.x, a.y, color });
+        lines.push_back({ b.x, b.y, color });
+    }
+    void triangle(const b2Vec2& a, const b2Vec2& b, const b2Vec2& c, DebugColor color) {
+        triangles.push_back({ a.x, a.y, color });
+        triangles.push_back({ b.x, b.y, color });
+        triangles.push_back({ c.x, c.y, color });
+    }
+
+    void DrawPolygon(const b2Vec2* vertices, int32 vertexCount, const b2Color& color) override {
+        DebugColor edge = convert(color);
+        for (int i = 0; i < vertexCount; i++) line(vertices[i], vertices[(i + 1) % vertexCount], edge);
+    }
+    void DrawSolidPolygon(const b2Vec2* vertices, int32 vertexCount, const b2Color& color) override {
+        DebugColor inside = convert(color, DEBUG_FILL_ALPHA);
+        for (int i = 1; i + 1 < vertexCount; i++) triangle(vertices[0], vertices[i], vertices[i + 1], inside);
+        DrawPolygon(vertices, vertexCount, color);
+    }
+    void DrawCircle(const b2Vec2& center, float radius, const b2Color& color) override {
+        DebugColor edge = convert(color);
+        for (int i = 0; i < DEBUG_CIRCLE_SEGMENTS; i++)
+            line(center + radius * unitCircle[i], center + radius * unitCircle[(i + 1) % DEBUG_CIRCLE_SEGMENTS], edge);
+    }
+    // Filled with the axis on top, an outline as well would double the lines for little
+    void DrawSolidCircle(const b2Vec2& center, float radius, const b2Vec2& axis, const b2Color& color) override {
+        DebugColor inside = convert(color, DEBUG_FILL_ALPHA);
+        size_t start = triangles.size();
+        triangles.resize(start + 3 * (DEBUG_CIRCLE_SEGMENTS - 2));
+        DebugVertex* out = &triangles[start];
+        DebugVertex first = { center.x + radius * unitCircle[0].x, center.y + radius * unitCircle[0].y, inside };
+        DebugVertex previous = { center.x + radius * unitCircle[1].x, center.y + radius * unitCircle[1].y, inside };
+        for (int i = 2; i < DEBUG_CIRCLE_SEGMENTS; i++) {
+            DebugVertex next = { center.x + radius * unitCircle[i].x, center.y + radius * unitCircle[i].y, inside };
+            *out++ = first;
+            *out++ = previous;
+            *out++ = next;
+            previous = next;
+        }
+        line(center, center + radius * axis, convert(color));
+    }
+    void DrawSegment(const b2Vec2& p1, const b2Vec2& p2, const b2Color& color) override {
+        line(p1, p2, convert(color));
+    }
+    void DrawTransform(const b2Transform& xf) override {
+        line(xf.p, xf.p + DEBUG_AXIS_LENGTH * xf.q.GetXAxis(), { 255, 0, 0, 255 });
+        line(xf.p, xf.p + DEBUG_AXIS_LENGTH * xf.q.GetYAxis(), { 0, 255, 0, 255 });
+    }
+    // Size is in pixels
+    void DrawPoint(const b2Vec2& p, float size, const b2Color& color) override {
+        DebugColor fill = convert(color);
+        float half = 0.5f * size * metersPerPixel;
+        b2Vec2 a(p.x - half, p.y - half), b(p.x + half, p.y - half), c(p.x + half, p.y + half), d(p.x - half, p.y + half);
+        triangle(a, b, c, fill);
+        triangle(a, c, d, fill);
+    }
+};
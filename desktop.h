@@ -0,0 +1,221 @@
+#pragma once
+
+#include "physics.h"
+#include "random.h"
+#include <SDL2/SDL.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <dwmapi.h>
+#endif
+#include <algorithm>
+#include <vector>
+
+const int MIN_WINDOW_SIZE = 4; // Pixels, anything thinner makes no usable box
+
+// A top level window in overlay pixels. The id stays the same for as long as
+// the window is open
+struct DesktopWindow
+{
+    Uint64 id;
+    int left, top, right, bottom;
+};
+
+inline bool sameRect(const DesktopWindow& a, const DesktopWindow& b)
+{
+    return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+}
+
+// Lists the other windows on the desktop, in any order
+struct WindowProvider
+{
+    virtual ~WindowProvider() {}
+    virtual void enumerate(std::vector<DesktopWindow>& windows) = 0;
+};
+
+#ifdef _WIN32
+// Visible top level windows from EnumWindows. Minimized windows and the ones
+// DWM cloaks, like suspended store apps and windows on other virtual
+// desktops, are visible to Win32 but not on the screen. Maximized windows
+// are left out too, one stops at the taskbar and would squeeze every circle
+// into the strip below it
+struct Win32WindowProvider : WindowProvider
+{
+    HWND overlay;
+    RECT origin;
+    std::vector<DesktopWindow>* found = NULL;
+
+    explicit Win32WindowProvider(HWND overlay) : overlay(overlay) {}
+
+    void enumerate(std::vector<DesktopWindow>& windows) override {
+        if (!GetWindowRect(overlay, &origin)) return;
+        found = &windows;
+        EnumWindows(addWindow, (LPARAM)this);
+    }
+
+    static BOOL CALLBACK addWindow(HWND hwnd, LPARAM param) {
+        Win32WindowProvider* self = (Win32WindowProvider*)param;
+        if (hwnd == self->overlay || !IsWindowVisible(hwnd) || IsIconic(hwnd) || IsZoomed(hwnd)) return TRUE;
+        DWORD cloaked = 0;
+        if (SUCCEEDED(DwmGetWindowAttribute(hwnd, DWMWA_CLOAKED, &cloaked, sizeof(cloaked))) && cloaked) return TRUE;
+        RECT rect;
+        if (!GetWindowRect(hwnd, &rect)) return TRUE;
+        DesktopWindow window = { (Uint64)(uintptr_t)hwnd, (int)(rect.left - self->origin.left), (int)(rect.top - self->origin.top),
+                                 (int)(rect.right - self->origin.left), (int)(rect.bottom - self->origin.top) };
+        self->found->push_back(window);
+        return TRUE;
+    }
+};
+#endif
+
+// Plays a desktop back one frame per call, the last frame then stays. It and
+// everything below build without Windows, so the diffing can be driven anywhere
+struct ScriptedWindowProvider : WindowProvider
+{
+    std::vector<std::vector<DesktopWindow>> frames;
+    size_t frame = 0;
+
+    void enumerate(std::vector<DesktopWindow>& windows) override {
+        if (frames.empty()) return;
+        const std::vector<DesktopWindow>& current = frames[SDL_min(frame, frames.size() - 1)];
+        windows.insert(windows.end(), current.begin(), current.end());
+        frame++;
+    }
+};
+
+// A busy desktop of count windows on a width by height overlay. Every frame
+// about one in ten windows is dragged, one in fifty resized and one in a
+// hundred closed and replaced by a new one
+inline ScriptedWindowProvider* scriptedDesktop(int count, int frameCount, int width, int height, Uint64 seed)
+{
+    Rng rng(seed);
+    Uint64 nextId = 1;
+    auto open = [&]() {
+        int w = rng.range(width / 24, width / 8), h = rng.range(height / 24, height / 8);
+        int left = rng.range(-w / 2, width - w / 2), top = rng.range(-h / 2, height - h / 2);
+        DesktopWindow window = { nextId++, left, top, left + w, top + h };
+        return window;
+    };
+
+    ScriptedWindowProvider* provider = new ScriptedWindowProvider();
+    std::vector<DesktopWindow> windows;
+    for (int i = 0; i < count; i++) windows.push_back(open());
+    for (int f = 0; f < frameCount; f++) {
+        for (DesktopWindow& window : windows) {
+            Uint32 roll = rng.below(100);
+            if (roll < 10) {
+                int dx = rng.range(-20, 20), dy = rng.range(-20, 20);
+                window.left += dx;
+                window.right += dx;
+                window.top += dy;
+                window.bottom += dy;
+            }
+            else if (roll < 12) {
+                window.right = SDL_max(window.right + rng.range(-20, 20), window.left + MIN_WINDOW_SIZE);
+                window.bottom = SDL_max(window.bottom + rng.range(-20, 20), window.top + MIN_WINDOW_SIZE);
+            }
+            else if (roll < 13) window = open();
+        }
+        provider->frames.push_back(windows);
+    }
+    return provider;
+}
+
+// Keeps a static obstacle in the physics world for every window on the
+// overlay. Each poll sorts the windows by id and merges them with the ones
+// from the last poll, so only windows that opened, moved, resized or closed
+// touch the world, and the rest cost a comparison. The stacking order is
+// ignored, every window is solid. Windows off the overlay, too thin, or
+// covering all of it are left out, a full screen window would push every
+// circle out at once. Providers leave out maximized windows themselves
+struct DesktopColliders
+{
+    struct Tracked
+    {
+        DesktopWindow window;
+        int obstacle;
+    };
+
+    WindowProvider* provider;
+    float interval;    // Seconds between polls
+    int width, height; // Overlay in pixels
+    float untilPoll = 0.0f;
+    std::vector<Tracked> tracked, merged; // Sorted by id
+    std::vector<DesktopWindow> current;
+
+    Uint64 polls = 0, windowsSeen = 0, created = 0, moved = 0, destroyed = 0;
+    Uint64 enumerateTicks = 0, updateTicks = 0, worstTicks = 0;
+
+    DesktopColliders(WindowProvider* provider, float interval, int width, int height)
+        : provider(provider), interval(interval), width(width), height(height) {}
+    ~DesktopColliders() {
+        delete provider;
+    }
+
+    void update(PhysicsWorld& world, float deltaTime) {
+        untilPoll -= deltaTime;
+        if (untilPoll > 0.0f) return;
+        untilPoll = SDL_max(untilPoll + interval, 0.0f);
+        poll(world);
+    }
+
+    void poll(PhysicsWorld& world) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        current.clear();
+        provider->enumerate(current);
+        Uint64 enumerated = SDL_GetPerformanceCounter();
+
+        current.erase(std::remove_if(current.begin(), current.end(), [this](const DesktopWindow& window) { return !usable(window); }), current.end());
+        std::sort(current.begin(), current.end(), [](const DesktopWindow& a, const DesktopWindow& b) { return a.id < b.id; });
+        merged.clear();
+        size_t old = 0;
+        for (const DesktopWindow& window : current) {
+            for (; old < tracked.size() && tracked[old].window.id < window.id; old++) close(world, tracked[old]);
+            if (old < tracked.size() && tracked[old].window.id == window.id) {
+                Tracked& known = tracked[old++];
+                if (!sameRect(known.window, window)) {
+                    world.moveObstacle(known.obstacle, toBox(window));
+                    moved++;
+                }
+                merged.push_back({ window, known.obstacle });
+                continue;
+            }
+            merged.push_back({ window, world.createObstacle(toBox(window)) });
+            created++;
+        }
+        for (; old < tracked.size(); old++) close(world, tracked[old]);
+        tracked.swap(merged);
+
+        Uint64 end = SDL_GetPerformanceCounter();
+        polls++;
+        windowsSeen += tracked.size();
+        enumerateTicks += enumerated - start;
+        updateTicks += end - enumerated;
+        worstTicks = SDL_max(worstTicks, end - start);
+    }
+
+    void close(PhysicsWorld& world, const Tracked& gone) {
+        world.destroyObstacle(gone.obstacle);
+        destroyed++;
+    }
+
+    bool usable(const DesktopWindow& window) const {
+        if (window.right - window.left < MIN_WINDOW_SIZE || window.bottom - window.top < MIN_WINDOW_SIZE) return false;
+        if (window.right <= 0 || window.bottom <= 0 || window.left >= width || window.top >= height) return false;
+        return !(window.left <= 0 && window.top <= 0 && window.right >= width && window.bottom >= height);
+    }
+
+    static b2AABB toBox(const DesktopWindow& window) {
+        b2AABB box;
+        box.lowerBound.Set(window.left / PIXELS_PER_METER, window.top / PIXELS_PER_METER);
+        box.upperBound.Set(window.right / PIXELS_PER_METER, window.bottom / PIXELS_PER_METER);
+        return box;
+    }
+
+    void logStats() const {
+        if (polls == 0) return;
+        double frequency = (double)SDL_GetPerformanceFrequency();
+        SDL_Log("Desktop: %llu polls of %.1f windows, %.2f opened, %.2f moved and %.2f closed per poll, %.4f ms enumerating and %.4f ms updating per poll on average, %.4f ms at most",
+            (unsigned long long)polls, (double)windowsSeen / polls, (double)created / polls, (double)moved / polls, (double)destroyed / polls,
+            enumerateTicks * 1000.0 / frequency / polls, updateTicks * 1000.0 / frequency / polls, worstTicks * 1000.0 / frequency);
+    }
+};
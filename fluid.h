@@ -0,0 +1,267 @@
+#pragma once
+
+#include "broadphase.h"
+#include "simd.h"
+#include "threadpool.h"
+#include <SDL2/SDL_stdinc.h>
+#include <math.h>
+#include <vector>
+
+const int FLUID_PADDING = 4;         // Particles past the end, far away, so SSE loads never leave the arrays
+const float FLUID_FAR = 1e6f;
+const int PARTICLES_PER_TASK = 1024;
+
+struct FluidSettings
+{
+    float spacing = 0.05f;        // Particle spacing at rest, in world units
+    float stiffness = 120.0f;     // How hard density above rest pushes back
+    float nearStiffness = 300.0f; // Keeps particles from clumping, and gives a bit of surface tension
+    float viscosity = 0.5f;       // How strongly neighbours even out their velocities
+    float gravity = 9.8f;         // Down the screen, the circles don't feel it
+    int subSteps = 3;
+};
+
+// A rigid circle the fluid flows around. It pushes the fluid but the fluid
+// doesn't push back
+struct FluidObstacle
+{
+    float x, y, radius;
+};
+
+// Particle fluid for lots of tiny particles that never become bodies, using
+// the double density relaxation of Clavet et al. Particles move ballistically,
+// then every particle is pushed out of its neighbours by the pressure of the
+// density around both, and the velocity is whatever the move came to. Being
+// position based it stays stable at our step size where force based SPH needs
+// many sub-steps.
+// Particles are stored SoA and counting sorted into grid cells every sub-step,
+// so the neighbours of a particle are three contiguous runs of the arrays, one
+// per row of cells, which the density and relaxation passes walk four at a
+// time. Each particle only gathers from its neighbours and writes itself, so
+// the passes run on the pool
+struct ParticleFluid
+{
+    FluidSettings settings;
+    float width, height;                // In world units
+    float smoothing, particleRadius;
+    float restDensity;
+    int count = 0;
+    std::vector<float> x, y, vx, vy;
+    std::vector<float> previousX, previousY;
+    std::vector<float> density, nearDensity;
+    std::vector<float> pressure, nearPressure;
+    std::vector<FluidObstacle> obstacles;
+    UniformGrid grid;
+    ThreadPool pool;
+
+    ParticleFluid(const FluidSettings& settings, float width, float height, int threads)
+        : settings(settings), width(width), height(height), pool(threads) {
+        smoothing = 2.0f * settings.spacing;
+        particleRadius = 0.5f * settings.spacing;
+
+        // The density of a square lattice at rest spacing, so a calm pool feels no pressure
+        restDensity = 0.0f;
+        int reach = (int)ceilf(smoothing / settings.spacing);
+        for (int i = -reach; i <= reach; i++) {
+            for (int j = -reach; j <= reach; j++) {
+                float q = sqrtf((float)(i * i + j * j)) * settings.spacing / smoothing;
+                if (q > 0.0f && q < 1.0f) restDensity += (1.0f - q) * (1.0f - q);
+            }
+        }
+
+        grid.configure(width, height, 0.5f * smoothing);
+        resize(0);
+    }
+
+    void resize(int particles) {
+        for (std::vector<float>* array : { &x, &y, &previousX, &previousY, &relaxedX, &relaxedY }) array->resize(particles + FLUID_PADDING, FLUID_FAR);
+        for (std::vector<float>* array : { &vx, &vy, &density, &nearDensity, &pressure, &nearPressure }) array->resize(particles + FLUID_PADDING, 0.0f);
+        cellRadius.resize(particles, 0.5f * smoothing);
+        for (int i = particles; i < particles + FLUID_PADDING; i++) x[i] = y[i] = FLUID_FAR;
+    }
+
+    // A square block of particles on the rest lattice hanging from the top of
+    // the screen, centered at centerX
+    void spawnBlock(int particles, float centerX) {
+        int columns = SDL_min((int)ceilf(sqrtf((float)particles)), (int)(width / settings.spacing) - 1);
+        float left = SDL_max(centerX - 0.5f * columns * settings.spacing, particleRadius);
+        int first = count;
+        count += particles;
+        resize(count);
+        for (int i = 0; i < particles; i++) {
+            // Odd rows are staggered a little so no two particles ever line up exactly
+            x[first + i] = left + (i % columns + 0.05f * ((i / columns) & 1)) * settings.spacing;
+            y[first + i] = particleRadius + (i / columns) * settings.spacing;
+        }
+    }
+
+    void step(float deltaTime) {
+        if (count == 0 || deltaTime <= 0.0f) return;
+        float subStep = deltaTime / settings.subSteps;
+        for (int s = 0; s < settings.subSteps; s++) {
+            pool.parallelFor(count, PARTICLES_PER_TASK, [this, subStep](int begin, int end) {
+                for (int i = begin; i < end; i++) predict(i, subStep);
+            });
+            sortParticles();
+            pool.parallelFor(count, PARTICLES_PER_TASK, [this](int begin, int end) {
+                for (int i = begin; i < end; i++) computeDensity(i);
+            });
+            pool.parallelFor(count, PARTICLES_PER_TASK, [this, subStep](int begin, int end) {
+                for (int i = begin; i < end; i++) relax(i, subStep);
+            });
+            x.swap(relaxedX);
+            y.swap(relaxedY);
+            for (const FluidObstacle& obstacle : obstacles) pushOut(obstacle);
+            pool.parallelFor(count, PARTICLES_PER_TASK, [this, subStep](int begin, int end) {
+                for (int i = begin; i < end; i++) updateVelocity(i, subStep);
+            });
+        }
+    }
+
+    // Average distance from rest density, a measure of how compressed it is
+    float densityError() const {
+        double error = 0.0;
+        for (int i = 0; i < count; i++) error += fabsf(density[i] - restDensity);
+        return count ? (float)(error / count / restDensity) : 0.0f;
+    }
+
+private:
+    std::vector<float> cellRadius; // Half the smoothing radius for every particle, so the grid cells are one radius wide
+    std::vector<float> relaxedX, relaxedY;
+    std::vector<float> scratch;
+
+    void predict(int i, float deltaTime) {
+        vy[i] += deltaTime * settings.gravity;
+
+        // Nothing may cross more than half a smoothing radius in one sub-step
+        float maxSpeed = 0.5f * smoothing / deltaTime;
+        float speed2 = vx[i] * vx[i] + vy[i] * vy[i];
+        if (speed2 > maxSpeed * maxSpeed) {
+            float scale = maxSpeed / sqrtf(speed2);
+            vx[i] *= scale;
+            vy[i] *= scale;
+        }
+        previousX[i] = x[i];
+        previousY[i] = y[i];
+        x[i] += deltaTime * vx[i];
+        y[i] += deltaTime * vy[i];
+    }
+
+    void sortParticles() {
+        grid.rebuild(x.data(), y.data(), cellRadius.data(), count);
+        SDL_memcpy(x.data(), grid.sortedX.data(), count * sizeof(float));
+        SDL_memcpy(y.data(), grid.sortedY.data(), count * sizeof(float));
+        for (std::vector<float>* array : { &vx, &vy, &previousX, &previousY }) {
+            scratch.resize(array->size());
+            for (int i = 0; i < count; i++) scratch[i] = (*array)[grid.sortedBody[i]];
+            for (int i = count; i < count + FLUID_PADDING; i++) scratch[i] = (*array)[i];
+            array->swap(scratch);
+        }
+    }
+
+    // Calls visit(first, last) for the three runs of sorted particles in the
+    // cells around a point
+    template <typename Visit>
+    void forEachNeighbourRun(float px, float py, Visit&& visit) const {
+        int cx = SDL_clamp((int)(px / grid.cellSize), 0, grid.columns - 1);
+        int cy = SDL_clamp((int)(py / grid.cellSize), 0, grid.rows - 1);
+        int left = SDL_max(cx - 1, 0), right = SDL_min(cx + 1, grid.columns - 1);
+        for (int row = SDL_max(cy - 1, 0); row <= SDL_min(cy + 1, grid.rows - 1); row++) {
+            visit(grid.cellStart[row * grid.columns + left], grid.cellStart[row * grid.columns + right + 1]);
+        }
+    }
+
+    static __m128 laneMask(int first, int last) {
+        __m128i lanes = _mm_add_epi32(_mm_set1_epi32(first), _mm_setr_epi32(0, 1, 2, 3));
+        return _mm_castsi128_ps(_mm_cmplt_epi32(lanes, _mm_set1_epi32(last)));
+    }
+
+    // Falloff 1 - r/h of the neighbours in range, zero for everything else
+    // including the particle itself
+    __m128 falloff(int j, int last, __m128 px, __m128 py, __m128& dx, __m128& dy, __m128& distance) const {
+        __m128 tiny = _mm_set1_ps(1e-12f), h = _mm_set1_ps(smoothing), inverseH = _mm_set1_ps(1.0f / smoothing);
+        dx = _mm_sub_ps(_mm_loadu_ps(&x[j]), px);
+        dy = _mm_sub_ps(_mm_loadu_ps(&y[j]), py);
+        __m128 r2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+        __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmplt_ps(r2, _mm_mul_ps(h, h)), _mm_cmpgt_ps(r2, tiny)), laneMask(j, last));
+        distance = _mm_sqrt_ps(_mm_max_ps(r2, tiny));
+        return _mm_and_ps(inside, _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(distance, inverseH)));
+    }
+
+    void computeDensity(int i) {
+        __m128 px = _mm_set1_ps(x[i]), py = _mm_set1_ps(y[i]);
+        __m128 sum = _mm_setzero_ps(), nearSum = _mm_setzero_ps();
+        forEachNeighbourRun(x[i], y[i], [&](int first, int last) {
+            for (int j = first; j < last; j += 4) {
+                __m128 dx, dy, distance;
+                __m128 q = falloff(j, last, px, py, dx, dy, distance);
+                __m128 q2 = _mm_mul_ps(q, q);
+                sum = _mm_add_ps(sum, q2);
+                nearSum = _mm_add_ps(nearSum, _mm_mul_ps(q2, q));
+            }
+        });
+        density[i] = horizontalSum(sum);
+        nearDensity[i] = horizontalSum(nearSum);
+        pressure[i] = settings.stiffness * (density[i] - restDensity);
+        nearPressure[i] = settings.nearStiffness * nearDensity[i];
+    }
+
+    // Half of each pair's displacement, the neighbour moves itself by the
+    // other half. Viscosity pulls the velocity towards the neighbours'
+    void relax(int i, float deltaTime) {
+        __m128 px = _mm_set1_ps(x[i]), py = _mm_set1_ps(y[i]);
+        __m128 pvx = _mm_set1_ps(vx[i]), pvy = _mm_set1_ps(vy[i]);
+        __m128 pressureI = _mm_set1_ps(pressure[i]), nearPressureI = _mm_set1_ps(nearPressure[i]);
+        __m128 pushX = _mm_setzero_ps(), pushY = _mm_setzero_ps();
+        __m128 dragX = _mm_setzero_ps(), dragY = _mm_setzero_ps(), weight = _mm_setzero_ps();
+        forEachNeighbourRun(x[i], y[i], [&](int first, int last) {
+            for (int j = first; j < last; j += 4) {
+                __m128 dx, dy, distance;
+                __m128 q = falloff(j, last, px, py, dx, dy, distance);
+                __m128 p = _mm_add_ps(pressureI, _mm_loadu_ps(&pressure[j]));
+                __m128 near = _mm_add_ps(nearPressureI, _mm_loadu_ps(&nearPressure[j]));
+                __m128 push = _mm_div_ps(_mm_mul_ps(q, _mm_add_ps(p, _mm_mul_ps(near, q))), distance);
+                pushX = _mm_add_ps(pushX, _mm_mul_ps(push, dx));
+                pushY = _mm_add_ps(pushY, _mm_mul_ps(push, dy));
+
+                dragX = _mm_add_ps(dragX, _mm_mul_ps(q, _mm_sub_ps(_mm_loadu_ps(&vx[j]), pvx)));
+                dragY = _mm_add_ps(dragY, _mm_mul_ps(q, _mm_sub_ps(_mm_loadu_ps(&vy[j]), pvy)));
+                weight = _mm_add_ps(weight, q);
+            }
+        });
+        // Pressures of both particles are summed, so a quarter each way is half a pair
+        float scale = 0.25f * deltaTime * deltaTime;
+        float drag = deltaTime * settings.viscosity / (1.0f + horizontalSum(weight));
+        relaxedX[i] = x[i] - scale * horizontalSum(pushX) + drag * horizontalSum(dragX);
+        relaxedY[i] = y[i] - scale * horizontalSum(pushY) + drag * horizontalSum(dragY);
+    }
+
+    // The walls just hold particles in, whatever speed they hit with is lost
+    void updateVelocity(int i, float deltaTime) {
+        x[i] = SDL_clamp(x[i], particleRadius, width - particleRadius);
+        y[i] = SDL_clamp(y[i], particleRadius, height - particleRadius);
+        vx[i] = (x[i] - previousX[i]) / deltaTime;
+        vy[i] = (y[i] - previousY[i]) / deltaTime;
+    }
+
+    // Moves particles out of a circle. A moving circle shoves them, since the
+    // velocity comes from how far they ended up moving
+    void pushOut(const FluidObstacle& obstacle) {
+        float reach = obstacle.radius + particleRadius;
+        int left = SDL_clamp((int)((obstacle.x - reach) / grid.cellSize) - 1, 0, grid.columns - 1);
+        int right = SDL_clamp((int)((obstacle.x + reach) / grid.cellSize) + 1, 0, grid.columns - 1);
+        int top = SDL_clamp((int)((obstacle.y - reach) / grid.cellSize) - 1, 0, grid.rows - 1);
+        int bottom = SDL_clamp((int)((obstacle.y + reach) / grid.cellSize) + 1, 0, grid.rows - 1);
+        for (int row = top; row <= bottom; row++) {
+            for (int i = grid.cellStart[row * grid.columns + left]; i < grid.cellStart[row * grid.columns + right + 1]; i++) {
+                float dx = x[i] - obstacle.x, dy = y[i] - obstacle.y;
+                float distance2 = dx * dx + dy * dy;
+                if (distance2 >= reach * reach) continue;
+                float distance = sqrtf(distance2);
+                float nx = distance > 1e-6f ? dx / distance : 0.0f, ny = distance > 1e-6f ? dy / distance : -1.0f;
+                x[i] = obstacle.x + nx * reach;
+                y[i] = obstacle.y + ny * reach;
+            }
+        }
+    }
+};
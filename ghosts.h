@@ -0,0 +1,83 @@
+#pragma once
+
+#include "random.h"
+#include "simd.h"
+#include <SDL2/SDL_stdinc.h>
+#include <emmintrin.h>
+#include <vector>
+
+const float GHOST_RESTITUTION = 0.6f;
+
+// Decorative particles that never enter a physics world. They fall, bounce off
+// the screen edges and fade out, but never touch each other or the circles,
+// so a step is one SSE pass over SoA arrays however many there are. All
+// storage is allocated up front and dead particles are replaced by the last
+// live one, so emitting never allocates
+struct GhostParticles
+{
+    float width, height; // Screen in world units
+    float gravity = 9.8f;
+    int count = 0, capacity;
+    std::vector<float> x, y, velocityX, velocityY, life; // Life is seconds left
+    Rng rng;
+
+    GhostParticles(int capacity, float width, float height, Uint64 seed)
+        : width(width), height(height), capacity(capacity), rng(seed) {
+        // Room for a whole group of four past the last particle
+        for (std::vector<float>* array : { &x, &y, &velocityX, &velocityY, &life }) array->resize(capacity + 4, 0.0f);
+    }
+
+    // Up to emitCount particles at a point, flying off at up to maxSpeed per axis
+    void emit(int emitCount, float px, float py, float maxSpeed, float lifetime) {
+        emitCount = SDL_min(emitCount, capacity - count);
+        if (emitCount <= 0) return;
+        for (int i = count; i < count + emitCount; i++) {
+            x[i] = px;
+            y[i] = py;
+        }
+        RngBatch lanes(rng);
+        lanes.fillUniform(velocityX.data() + count, emitCount, -maxSpeed, maxSpeed);
+        lanes.fillUniform(velocityY.data() + count, emitCount, -maxSpeed, maxSpeed);
+        lanes.fillUniform(life.data() + count, emitCount, 0.5f * lifetime, lifetime);
+        count += emitCount;
+    }
+
+    void step(float deltaTime) {
+        __m128 dt = _mm_set1_ps(deltaTime), fall = _mm_set1_ps(gravity * deltaTime);
+        __m128 zero = _mm_setzero_ps(), right = _mm_set1_ps(width), bottom = _mm_set1_ps(height);
+        __m128 bounce = _mm_set1_ps(-GHOST_RESTITUTION);
+        for (int i = 0; i < count; i += 4) {
+            __m128 px = _mm_loadu_ps(&x[i]), py = _mm_loadu_ps(&y[i]);
+            __m128 vx = _mm_loadu_ps(&velocityX[i]), vy = _mm_add_ps(_mm_loadu_ps(&velocityY[i]), fall);
+            px = _mm_add_ps(px, _mm_mul_ps(vx, dt));
+            py = _mm_add_ps(py, _mm_mul_ps(vy, dt));
+
+            // Past an edge, back onto it and bounce
+            __m128 outX = _mm_or_ps(_mm_cmplt_ps(px, zero), _mm_cmpgt_ps(px, right));
+            __m128 outY = _mm_or_ps(_mm_cmplt_ps(py, zero), _mm_cmpgt_ps(py, bottom));
+            vx = selectLanes(outX, _mm_mul_ps(vx, bounce), vx);
+            vy = selectLanes(outY, _mm_mul_ps(vy, bounce), vy);
+            px = _mm_max_ps(zero, _mm_min_ps(px, right));
+            py = _mm_max_ps(zero, _mm_min_ps(py, bottom));
+
+            _mm_storeu_ps(&x[i], px);
+            _mm_storeu_ps(&y[i], py);
+            _mm_storeu_ps(&velocityX[i], vx);
+            _mm_storeu_ps(&velocityY[i], vy);
+            _mm_storeu_ps(&life[i], _mm_sub_ps(_mm_loadu_ps(&life[i]), dt));
+        }
+
+        for (int i = 0; i < count;) {
+            if (life[i] > 0.0f) {
+                i++;
+                continue;
+            }
+            count--;
+            x[i] = x[count];
+            y[i] = y[count];
+            velocityX[i] = velocityX[count];
+            velocityY[i] = velocityY[count];
+            life[i] = life[count];
+        }
+    }
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "physics.h"
+#include <SDL2/SDL.h>
+
+struct SolverQuality
+{
+    int subSteps;
+    int velocityIterations;
+    int positionIterations;
+};
+
+// Cheapest first. DEFAULT_QUALITY is the 6 and 2 iterations we always used
+const SolverQuality QUALITY_LEVELS[] = {
+    { 1, 2, 1 },
+    { 1, 3, 1 },
+    { 1, 4, 2 },
+    { 1, 6, 2 },
+    { 1, 8, 3 },
+    { 2, 6, 2 },
+    { 2, 8, 3 },
+    { 3, 8, 3 },
+};
+const int QUALITY_LEVEL_COUNT = sizeof(QUALITY_LEVELS) / sizeof(QUALITY_LEVELS[0]);
+const int DEFAULT_QUALITY = 3;
+
+const float GOVERNOR_SMOOTHING = 0.1f; // Weight of the newest step in the average
+const int DROP_AFTER = 3;              // Steps over budget before lowering quality
+const int RAISE_AFTER = 60;            // Steps with headroom before raising it
+const float RAISE_HEADROOM = 0.7f;     // The next level must fit in this much of the budget
+
+// Rough relative cost of a level, contacts are found again every sub-step
+inline float qualityCost(const SolverQuality& quality)
+{
+    return quality.subSteps * (2.0f + quality.velocityIterations + 0.5f * quality.positionIterations);
+}
+
+// Picks the solver quality for each step from how long the steps take. It
+// drops a level as soon as the smoothed step time stays over budget, but only
+// climbs when the next level's predicted time has fit comfortably for a
+// second, so a scene right at the edge doesn't flip between two levels.
+// Step times depend on the machine, so it can't run while recording
+struct SolverGovernor
+{
+    float budgetMs;
+    int minLevel = 0, maxLevel = QUALITY_LEVEL_COUNT - 1;
+    int level = DEFAULT_QUALITY;
+    float averageMs = 0.0f;
+    int overSteps = 0, calmSteps = 0;
+
+    Uint64 steps = 0, misses = 0, raises = 0, drops = 0;
+    Uint64 stepsAtLevel[QUALITY_LEVEL_COUNT] = {};
+    float worstMs = 0.0f;
+
+    SolverGovernor(float budgetMs, int minLevel, int maxLevel) : budgetMs(budgetMs) {
+        this->minLevel = SDL_clamp(minLevel, 0, QUALITY_LEVEL_COUNT - 1);
+        this->maxLevel = SDL_clamp(maxLevel, this->minLevel, QUALITY_LEVEL_COUNT - 1);
+        level = SDL_clamp(level, this->minLevel, this->maxLevel);
+    }
+
+    void step(PhysicsWorld& world, float deltaTime) {
+        const SolverQuality& quality = QUALITY_LEVELS[level];
+        world.subSteps = quality.subSteps;
+        world.velocityIterations = quality.velocityIterations;
+        world.positionIterations = quality.positionIterations;
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        world.step(deltaTime);
+        record((float)((SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency()));
+    }
+
+    void record(float stepMs) {
+        steps++;
+        stepsAtLevel[level]++;
+        if (stepMs > budgetMs) misses++;
+        worstMs = SDL_max(worstMs, stepMs);
+        averageMs = steps == 1 ? stepMs : averageMs + GOVERNOR_SMOOTHING * (stepMs - averageMs);
+
+        // A step far over budget counts toward a drop even while the average
+        // hasn't caught up with it yet, DROP_AFTER of them in a row drop a level
+        overSteps = averageMs > budgetMs || stepMs > 2.0f * budgetMs ? overSteps + 1 : 0;
+        if (overSteps >= DROP_AFTER && level > minLevel) {
+            changeLevel(level - 1);
+            drops++;
+            return;
+        }
+        if (level < maxLevel) {
+            float predicted = averageMs * qualityCost(QUALITY_LEVELS[level + 1]) / qualityCost(QUALITY_LEVELS[level]);
+            calmSteps = predicted < RAISE_HEADROOM * budgetMs ? calmSteps + 1 : 0;
+            if (calmSteps >= RAISE_AFTER) {
+                changeLevel(level + 1);
+                raises++;
+            }
+        }
+    }
+
+    // The average is rescaled to the new level so it doesn't have to wash out first
+    void changeLevel(int next) {
+        averageMs *= qualityCost(QUALITY_LEVELS[next]) / qualityCost(QUALITY_LEVELS[level]);
+        level = next;
+        overSteps = calmSteps = 0;
+        const SolverQuality& quality = QUALITY_LEVELS[level];
+        SDL_Log("Physics quality %d: %d sub-steps, %d velocity and %d position iterations (%.2f of %.2f ms)",
+            level, quality.subSteps, quality.velocityIterations, quality.positionIterations, averageMs, budgetMs);
+    }
+
+    void logStats() const {
+        if (steps == 0) return;
+        SDL_Log("Physics governor: %llu steps, %llu over the %.2f ms budget (%.1f%%), worst %.2f ms, %llu raises, %llu drops",
+            (unsigned long long)steps, (unsigned long long)misses, budgetMs, 100.0 * misses / steps, worstMs,
+            (unsigned long long)raises, (unsigned long long)drops);
+        for (int i = minLevel; i <= maxLevel; i++) {
+            const SolverQuality& quality = QUALITY_LEVELS[i];
+            SDL_Log("    level %d (%d x %d/%d): %.1f%% of steps", i, quality.subSteps, quality.velocityIterations,
+                quality.positionIterations, 100.0 * stepsAtLevel[i] / steps);
+        }
+    }
+};
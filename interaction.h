@@ -0,0 +1,102 @@
+#pragma once
+
+#include "physics.h"
+#include <SDL2/SDL.h>
+#include <math.h>
+#include <vector>
+
+enum CursorMode : Uint8
+{
+    CURSOR_OFF = 0,     // Cursor is off the screen
+    CURSOR_PUSH = 1,
+    CURSOR_GRAB = 2,
+    CURSOR_EXPLODE = 3, // Only in events, sets off one explosion and keeps the mode
+};
+
+// Distances in world units. Strengths are velocity changes so big and small
+// circles react the same, and all of them fade out linearly towards the edge
+struct CursorSettings
+{
+    float pushRadius = 3.0f;
+    float pushAcceleration = 80.0f; // m/s² right at the cursor
+    float grabRadius = 4.0f;
+    float grabStiffness = 6.0f;     // Speed towards the cursor per meter away
+    float explosionRadius = 8.0f;
+    float explosionSpeed = 30.0f;   // m/s right at the center
+};
+
+// Pushes circles away from the cursor, pulls them along while grabbing and
+// blows them apart on an explosion. Every step asks the world once for the
+// bodies in a box around the cursor, as wide as the largest active reach,
+// then hands out all impulses in one pass over the result
+struct CursorInteraction
+{
+    CursorSettings settings;
+    CursorMode mode = CURSOR_OFF;
+    float x = 0.0f, y = 0.0f; // World units
+    bool explosionPending = false;
+    std::vector<int> found;
+
+    Uint64 queries = 0, bodiesFound = 0, bodiesMoved = 0;
+    Uint64 queryTicks = 0, worstQueryTicks = 0;
+
+    explicit CursorInteraction(const CursorSettings& settings) : settings(settings) {}
+
+    void apply(PhysicsWorld& world, float deltaTime) {
+        bool explode = explosionPending;
+        explosionPending = false;
+        float reach = mode == CURSOR_PUSH ? settings.pushRadius : mode == CURSOR_GRAB ? settings.grabRadius : 0.0f;
+        if (explode) reach = SDL_max(reach, settings.explosionRadius);
+        if (reach <= 0.0f) return;
+
+        b2AABB box;
+        box.lowerBound.Set(x - reach, y - reach);
+        box.upperBound.Set(x + reach, y + reach);
+        found.clear();
+        Uint64 start = SDL_GetPerformanceCounter();
+        world.queryAABB(box, found);
+        Uint64 ticks = SDL_GetPerformanceCounter() - start;
+        queries++;
+        bodiesFound += found.size();
+        queryTicks += ticks;
+        worstQueryTicks = SDL_max(worstQueryTicks, ticks);
+
+        for (int body : found) {
+            BodyState state = world.getState(body);
+            float dx = state.position.x - x, dy = state.position.y - y;
+            float distance = sqrtf(dx * dx + dy * dy);
+            float nx = 0.0f, ny = 0.0f;
+            if (distance > 1e-4f) {
+                nx = dx / distance;
+                ny = dy / distance;
+            }
+
+            b2Vec2 change(0.0f, 0.0f);
+            if (mode == CURSOR_PUSH && distance < settings.pushRadius) {
+                float speed = settings.pushAcceleration * deltaTime * (1.0f - distance / settings.pushRadius);
+                change += b2Vec2(speed * nx, speed * ny);
+            }
+            // Steers towards a velocity that closes the gap, which damps the swing
+            if (mode == CURSOR_GRAB && distance < settings.grabRadius) {
+                b2Vec2 target(-settings.grabStiffness * dx, -settings.grabStiffness * dy);
+                float blend = SDL_min(settings.grabStiffness * deltaTime, 1.0f) * (1.0f - distance / settings.grabRadius);
+                change += blend * (target - state.velocity);
+            }
+            if (explode && distance < settings.explosionRadius) {
+                float speed = settings.explosionSpeed * (1.0f - distance / settings.explosionRadius);
+                change += b2Vec2(speed * nx, speed * ny);
+            }
+            if (change.x == 0.0f && change.y == 0.0f) continue;
+            world.applyImpulse(body, world.getMass(body) * change);
+            bodiesMoved++;
+        }
+    }
+
+    void logStats() const {
+        if (queries == 0) return;
+        double frequency = (double)SDL_GetPerformanceFrequency();
+        SDL_Log("Cursor: %llu queries, %.1f bodies found and %.1f moved per query, %.4f ms per query on average, %.4f ms at most",
+            (unsigned long long)queries, (double)bodiesFound / queries, (double)bodiesMoved / queries,
+            queryTicks * 1000.0 / frequency / queries, worstQueryTicks * 1000.0 / frequency);
+    }
+};
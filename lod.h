@@ -0,0 +1,91 @@
+#pragma once
+
+#include "physics.h"
+#include <SDL2/SDL.h>
+#include <math.h>
+#include <vector>
+
+// Speeds in m/s, distances in world units. A reduced body lags at most its
+// speed times the steps it sits out, so the speed limits bound the glitches
+struct LodSettings
+{
+    float reducedSpeed = 1.0f;  // Slower bodies near the focus are stepped at the reduced rate
+    float outsideSpeed = 4.0f;  // The same for bodies outside the focus
+    float focusRadius = 0.0f;   // Around the cursor, 0 puts the whole screen in focus
+    float sleepSpeed = 0.05f;   // Slower than this for sleepDelay seconds freezes a body
+    float sleepDelay = 0.5f;
+};
+
+// Sorts bodies into level of detail tiers before every step. Bodies the
+// screen barely shows moving are stepped at a lower rate, bodies at rest for
+// a while are frozen, and the engines wake both when something runs into
+// them. Nobody is looking when the cursor is off the screen, so then the
+// focus is gone and everything counts as outside it
+struct PhysicsLod
+{
+    LodSettings settings;
+    bool hasFocus = false;
+    float focusX = 0.0f, focusY = 0.0f;
+    std::vector<Uint8> tiers;
+    std::vector<float> slowTime; // How long each body has been slower than sleepSpeed
+
+    Uint64 steps = 0, wakes = 0;
+    Uint64 bodySteps[LOD_TIER_COUNT] = {};
+
+    explicit PhysicsLod(const LodSettings& settings) : settings(settings) {}
+
+    void setFocus(float x, float y, bool active) {
+        hasFocus = active && settings.focusRadius > 0.0f;
+        focusX = x;
+        focusY = y;
+    }
+
+    // Bodies 0 to count - 1, in the order the world created them
+    void update(PhysicsWorld& world, int count, float deltaTime) {
+        tiers.resize(count, LOD_FULL);
+        slowTime.resize(count, 0.0f);
+        steps++;
+        for (int i = 0; i < count; i++) {
+            BodyState state = world.getState(i);
+            LodTier tier = classify(i, state, deltaTime);
+            bodySteps[tier]++;
+            if (tier == tiers[i]) continue;
+            tiers[i] = tier;
+            world.setLod(i, tier);
+        }
+    }
+
+    LodTier classify(int body, const BodyState& state, float deltaTime) {
+        // The engine woke it, it has to come to rest all over again
+        if (tiers[body] == LOD_FROZEN) {
+            if (!state.awake) return LOD_FROZEN;
+            wakes++;
+            slowTime[body] = 0.0f;
+        }
+        else if (!state.awake) return LOD_FROZEN;
+
+        float speed = state.velocity.Length();
+        slowTime[body] = speed < settings.sleepSpeed ? slowTime[body] + deltaTime : 0.0f;
+        if (slowTime[body] >= settings.sleepDelay) return LOD_FROZEN;
+
+        bool inFocus = settings.focusRadius <= 0.0f;
+        if (hasFocus) {
+            float dx = state.position.x - focusX, dy = state.position.y - focusY;
+            inFocus = dx * dx + dy * dy < settings.focusRadius * settings.focusRadius;
+        }
+        return speed < (inFocus ? settings.reducedSpeed : settings.outsideSpeed) ? LOD_REDUCED : LOD_FULL;
+    }
+
+    // Furthest a reduced body can trail where it would be at full rate
+    float lagBound(float deltaTime) const {
+        return SDL_max(settings.reducedSpeed, settings.outsideSpeed) * (LOD_REDUCED_INTERVAL - 1) * deltaTime;
+    }
+
+    void logStats() const {
+        Uint64 total = bodySteps[LOD_FULL] + bodySteps[LOD_REDUCED] + bodySteps[LOD_FROZEN];
+        if (total == 0) return;
+        SDL_Log("Physics LOD: %llu steps, %.1f%% of body steps at full rate, %.1f%% reduced, %.1f%% frozen, %llu wakes",
+            (unsigned long long)steps, 100.0 * bodySteps[LOD_FULL] / total, 100.0 * bodySteps[LOD_REDUCED] / total,
+            100.0 * bodySteps[LOD_FROZEN] / total, (unsigned long long)wakes);
+    }
+};
@@ -7,30 +7,54 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <box2d/box2d.h>
+#include <thread>
+#include <vector>
+#include "attractors.h"
+#include "audio.h"
+#include "broadphase.h"
+#include "ccd.h"
+#include "debugdraw.h"
+#include "desktop.h"
+#include "circle_world.h"
+#include "fluid.h"
+#include "ghosts.h"
+#include "governor.h"
+#include "interaction.h"
+#include "lod.h"
+#include "physics.h"
+#include "random.h"
+#include "replay.h"
+#include "snapshot.h"
+#include "softbody.h"
+#include "spawn.h"
+#include "timescale.h"
+#include "trajectory.h"
+#include "treemonitor.h"
+#include "resource.h"
 
 const int NUM_AUDIOS = 31;
 const int WINDOW_WIDTH = GetSystemMetrics(SM_CXSCREEN) - 1;
 const int WINDOW_HEIGHT = GetSystemMetrics(SM_CYSCREEN) - 1;
-const float ASPECT_RATIO = (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT;
+const int DESKTOP_LEFT = GetSystemMetrics(SM_XVIRTUALSCREEN);
+const int DESKTOP_WIDTH = GetSystemMetrics(SM_CXVIRTUALSCREEN);
+const int MAX_CIRCLES = 1000;           // For the spawn timer, batches can go past it
+const int MAX_SPAWN_SOUNDS = 8;        // Per step, a burst would drown out everything
 
-GLint projectionMatrixLocation;
-GLint vertexColorLocation;
-glm::mat4 orthoMatrix;
-
-const char* vertexSource2D = R"(
+// Debug lines and triangles, every vertex has its own color
+const char* vertexSourceDebug = R"(
     #version 460 core
 
-    uniform mat4 projectionMatrix; // Projection matrix uniform
-    uniform vec4 vertexColor;      // Uniform color for all vertices
+    uniform mat4 worldMatrix; // World units to clip space
 
     layout (location = 0) in vec2 aPos;
+    layout (location = 1) in vec4 color;
 
     out vec4 fragColor; // Output color to fragment shader
 
     void main()
     {
-        gl_Position = projectionMatrix * vec4(aPos, 0.0, 1.0);
-        fragColor = vertexColor; // Pass the uniform color to the fragment shader
+        gl_Position = worldMatrix * vec4(aPos, 0.0, 1.0);
+        fragColor = color;
     }
 )";
 
@@ -45,6 +69,36 @@ const char* fragmentSource2D = R"(
     }
 )";
 
+// Fluid and ghost particles as round point sprites. Positions arrive as two
+// separate runs of floats straight from the SoA arrays, in world units
+const char* vertexSourcePoints = R"(
+    #version 460 core
+
+    uniform mat4 worldMatrix; // World units to clip space
+    uniform float pointSize;  // Pixels
+
+    layout (location = 0) in float x;
+    layout (location = 1) in float y;
+
+    void main()
+    {
+        gl_Position = worldMatrix * vec4(x, y, 0.0, 1.0);
+        gl_PointSize = pointSize;
+    }
+)";
+
+const char* fragmentSourcePoints = R"(
+    #version 460 core
+    uniform vec4 pointColor;
+    out vec4 FragColor;
+
+    void main()
+    {
+        if (length(gl_PointCoord - vec2(0.5)) > 0.5) discard;
+        FragColor = pointColor;
+    }
+)";
+
 HWND initTransparency(SDL_Window* window)
 {
     // Get HWND handle from SDL_Window
@@ -132,255 +186,2195 @@ GLuint initShaders(char* vertex, char* fragment)
     return shaderProgram;
 }
 
-int randomNum(int lower, int upper)
+// Blends see through colors over what is already drawn until GL_BLEND is
+// disabled again. The window's alpha builds up premultiplied, the way DWM
+// composites it over the desktop
+void enableBlending()
 {
-    return lower + rand() % (upper - lower + 1);
+    glEnable(GL_BLEND);
+    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 }
 
-struct Circle
+// Draws a whole particle system in a single point draw
+struct PointRenderer
 {
-    Circle(glm::vec3 color, int radius, glm::vec2 pos, b2World& world) : radius(radius), position(pos) {
-        generateVertices();
-        setupBuffers();
-        setupPhysics(world);
+    GLuint shader, VAO, VBO;
+    GLint worldMatrixLocation, pointSizeLocation, pointColorLocation;
+    glm::mat4 worldMatrix;
 
-        normColor.r = color.r / 255;
-        normColor.g = color.g / 255;
-        normColor.b = color.b / 255;
+    PointRenderer() {
+        shader = initShaders((char*)vertexSourcePoints, (char*)fragmentSourcePoints);
+        worldMatrixLocation = glGetUniformLocation(shader, "worldMatrix");
+        pointSizeLocation = glGetUniformLocation(shader, "pointSize");
+        pointColorLocation = glGetUniformLocation(shader, "pointColor");
+        worldMatrix = glm::ortho(0.0f, WINDOW_WIDTH / PIXELS_PER_METER, WINDOW_HEIGHT / PIXELS_PER_METER, 0.0f, -1.0f, 1.0f);
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+    ~PointRenderer() {
+        glDeleteBuffers(1, &VBO);
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteProgram(shader);
     }
-    void generateVertices() {
-        float normRadius = (float)radius / WINDOW_HEIGHT * 2;
-        float normX = -ASPECT_RATIO + (2.0f * position.x / WINDOW_WIDTH) * ASPECT_RATIO;
-        float normY = 1.0f - (2.0f * position.y / WINDOW_HEIGHT);
 
-        vertices[0][0] = normX;
-        vertices[0][1] = normY;
-        for (int i = 1; i <= segments; i++) {
-            float theta = 2.0f * float(M_PI) * float(i - 1) / float(segments - 1);
-            vertices[i][0] = normX + normRadius * (float)cos(theta);
-            vertices[i][1] = normY + normRadius * (float)sin(theta);
-        }
+    // The buffer is orphaned every frame so the driver never waits on the last draw
+    void render(const float* x, const float* y, int count, float pointSize, glm::vec4 color) {
+        if (count == 0) return;
+        GLsizeiptr run = count * sizeof(float);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, 2 * run, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, run, x);
+        glBufferSubData(GL_ARRAY_BUFFER, run, run, y);
+        glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)0);
+        glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)run);
+
+        glEnable(GL_PROGRAM_POINT_SIZE);
+        glUseProgram(shader);
+        glUniformMatrix4fv(worldMatrixLocation, 1, GL_FALSE, glm::value_ptr(worldMatrix));
+        glUniform1f(pointSizeLocation, pointSize);
+        glUniform4f(pointColorLocation, color.r, color.g, color.b, color.a);
+        enableBlending();
+        glDrawArrays(GL_POINTS, 0, count);
+        glDisable(GL_BLEND);
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
     }
-    void setupPhysics(b2World& world) {
-        b2BodyDef bodyDef;
-        bodyDef.type = b2_dynamicBody;
-        bodyDef.position.Set(position.x / 48.0f, position.y / 48.0f);
+};
+
+// Shapes the whole scene in world units. Every vertex is a point of a unit
+// mesh, turned and scaled by its instance and moved to where the body is
+const char* vertexSourceShapes = R"(
+    #version 460 core
+
+    uniform mat4 worldMatrix; // World units to clip space
 
-        b2CircleShape circle;
-        circle.m_radius = radius / 48.0f;
+    layout (location = 0) in vec2 aPos;      // Unit mesh
+    layout (location = 1) in vec4 placement; // x, y, angle and scale of the instance
+    layout (location = 2) in vec4 color;
 
-        b2FixtureDef fixtureDef;
-        fixtureDef.shape = &circle;
-        fixtureDef.density = 1.0f;
-        fixtureDef.friction = 1.0f;
-        fixtureDef.restitution = 0.75f;
+    out vec4 fragColor;
 
-        body = world.CreateBody(&bodyDef);
-        body->CreateFixture(&fixtureDef);
+    void main()
+    {
+        float c = cos(placement.z), s = sin(placement.z);
+        vec2 offset = placement.w * vec2(c * aPos.x - s * aPos.y, s * aPos.x + c * aPos.y);
+        gl_Position = worldMatrix * vec4(placement.xy + offset, 0.0, 1.0);
+        fragColor = color;
     }
-    void setupBuffers() {
+)";
+
+struct ShapeInstance
+{
+    float x, y, angle, scale; // World units
+    Uint8 red, green, blue, alpha;
+};
+
+// Layout glMultiDrawArraysIndirect reads its commands in
+struct DrawArraysCommand
+{
+    GLuint count, instanceCount, first, baseInstance;
+};
+
+// Draws every body of every shape with one multi draw. The unit meshes of
+// all shapes share one static buffer, the instances are sorted by mesh each
+// frame and each mesh draws its run of them as one command, so a scene of
+// every shape costs one call where a circle used to cost one of its own
+struct ShapeRenderer
+{
+    GLuint shader, VAO, meshVBO, instanceVBO, commandBuffer;
+    GLint worldMatrixLocation;
+    glm::mat4 worldMatrix;
+    ShapeMeshes meshes;
+    std::vector<ShapeInstance> instances, sorted;
+    std::vector<Uint8> meshOf; // Of each instance
+    std::vector<int> meshStart;
+    std::vector<DrawArraysCommand> commands;
+    size_t instanceCapacity = 0; // Instances instanceVBO has room for
+
+    Uint64 frames = 0, instancesDrawn = 0, commandsIssued = 0;
+
+    ShapeRenderer() {
+        shader = initShaders((char*)vertexSourceShapes, (char*)fragmentSource2D);
+        worldMatrixLocation = glGetUniformLocation(shader, "worldMatrix");
+        worldMatrix = glm::ortho(0.0f, WINDOW_WIDTH / PIXELS_PER_METER, WINDOW_HEIGHT / PIXELS_PER_METER, 0.0f, -1.0f, 1.0f);
+
         glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &meshVBO);
+        glGenBuffers(1, &instanceVBO);
+        glGenBuffers(1, &commandBuffer);
         glBindVertexArray(VAO);
 
-        glGenBuffers(1, &VBO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_DYNAMIC_DRAW);
-
+        glBindBuffer(GL_ARRAY_BUFFER, meshVBO);
+        glBufferData(GL_ARRAY_BUFFER, meshes.vertices.size() * sizeof(b2Vec2), meshes.vertices.data(), GL_STATIC_DRAW);
         glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
-        
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(b2Vec2), (void*)0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(ShapeInstance), (void*)0);
+        glVertexAttribDivisor(1, 1);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ShapeInstance), (void*)offsetof(ShapeInstance, red));
+        glVertexAttribDivisor(2, 1);
+
         glBindBuffer(GL_ARRAY_BUFFER, 0);
         glBindVertexArray(0);
     }
-    void applyForce(b2Vec2 force) {
-        body->ApplyForce(force, body->GetPosition(), true);
+    ~ShapeRenderer() {
+        glDeleteBuffers(1, &meshVBO);
+        glDeleteBuffers(1, &instanceVBO);
+        glDeleteBuffers(1, &commandBuffer);
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteProgram(shader);
     }
+
+    // Makes room for count instances a frame, so a burst doesn't grow the
+    // lists one push at a time or the instance buffer frame after frame
+    void reserve(size_t count) {
+        if (count <= instanceCapacity) return;
+        instances.reserve(count);
+        sorted.reserve(count);
+        meshOf.reserve(count);
+        instanceCapacity = count;
+    }
+
+    // Color from 0 to 1
+    void add(ShapeType type, int sides, b2Vec2 position, float angle, float radius, glm::vec3 color) {
+        ShapeInstance instance = { position.x, position.y, angle, radius,
+                                   (Uint8)(color.r * 255 + 0.5f), (Uint8)(color.g * 255 + 0.5f), (Uint8)(color.b * 255 + 0.5f), 255 };
+        instances.push_back(instance);
+        meshOf.push_back((Uint8)ShapeMeshes::index(type, sides));
+    }
+
+    // Draws what was added since the last call. A counting sort groups the
+    // instances by mesh, the buffers are orphaned so the driver never waits
+    // on the last frame's draw
     void render() {
-        glUniform4f(vertexColorLocation, normColor.r, normColor.g, normColor.b, 1.0f);
+        frames++;
+        if (instances.empty()) return;
+        int meshCount = (int)meshes.meshes.size();
+        meshStart.assign(meshCount + 1, 0);
+        for (Uint8 mesh : meshOf) meshStart[mesh + 1]++;
+        for (int mesh = 0; mesh < meshCount; mesh++) meshStart[mesh + 1] += meshStart[mesh];
+        commands.clear();
+        for (int mesh = 0; mesh < meshCount; mesh++) {
+            GLuint count = (GLuint)(meshStart[mesh + 1] - meshStart[mesh]);
+            if (count) commands.push_back({ (GLuint)meshes.meshes[mesh].count, count, (GLuint)meshes.meshes[mesh].first, (GLuint)meshStart[mesh] });
+        }
+        sorted.resize(instances.size());
+        for (size_t i = 0; i < instances.size(); i++) sorted[meshStart[meshOf[i]]++] = instances[i];
+
+        // The buffer keeps its capacity, and doubles when a frame outgrows it
+        if (sorted.size() > instanceCapacity) instanceCapacity = SDL_max(sorted.size(), 2 * instanceCapacity);
         glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLE_FAN, 0, segments + 1);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(ShapeInstance), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sorted.size() * sizeof(ShapeInstance), sorted.data());
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawArraysCommand), commands.data(), GL_STREAM_DRAW);
+
+        glUseProgram(shader);
+        glUniformMatrix4fv(worldMatrixLocation, 1, GL_FALSE, glm::value_ptr(worldMatrix));
+        glMultiDrawArraysIndirect(GL_TRIANGLES, (void*)0, (GLsizei)commands.size(), 0);
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
         glBindVertexArray(0);
+        instancesDrawn += instances.size();
+        commandsIssued += commands.size();
+        instances.clear();
+        meshOf.clear();
+    }
+
+    void logStats() const {
+        if (frames == 0) return;
+        SDL_Log("Shapes: %.1f instances in %.2f meshes per frame, one draw call each",
+            (double)instancesDrawn / frames, (double)commandsIssued / frames);
     }
-    void update() {
-        b2Vec2 pos = body->GetPosition();
-        position.x = pos.x * 48.0f;
-        position.y = pos.y * 48.0f;
-        generateVertices();
+};
+
+// Sends a DebugBatch to the GPU in one buffer, triangles first, and draws
+// it with one triangle and one line draw call
+struct DebugRenderer
+{
+    GLuint shader, VAO, VBO;
+    GLint worldMatrixLocation;
+    glm::mat4 worldMatrix;
+    DebugBatch batch;
+
+    Uint64 frames = 0, vertices = 0, ticks = 0; // Frames with a layer on, ticks until the draws are issued
+
+    DebugRenderer() : batch(PIXELS_PER_METER) {
+        shader = initShaders((char*)vertexSourceDebug, (char*)fragmentSource2D);
+        worldMatrixLocation = glGetUniformLocation(shader, "worldMatrix");
+        worldMatrix = glm::ortho(0.0f, WINDOW_WIDTH / PIXELS_PER_METER, WINDOW_HEIGHT / PIXELS_PER_METER, 0.0f, -1.0f, 1.0f);
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glBindVertexArray(VAO);
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_DYNAMIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(DebugVertex), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(DebugVertex), (void*)offsetof(DebugVertex, color));
         glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+    ~DebugRenderer() {
+        glDeleteBuffers(1, &VBO);
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteProgram(shader);
+    }
+
+    // Nothing runs while every flag is off. Frames with a layer on count
+    // even when it had nothing to draw
+    void render(PhysicsWorld& physics) {
+        if (batch.GetFlags() == 0) return;
+        frames++;
+        Uint64 start = SDL_GetPerformanceCounter();
+        batch.clear();
+        physics.debugDraw(batch);
+        GLsizei triangleCount = (GLsizei)batch.triangles.size(), lineCount = (GLsizei)batch.lines.size();
+        vertices += triangleCount + lineCount;
+        if (triangleCount + lineCount > 0) {
+            glBindVertexArray(VAO);
+            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+            glBufferData(GL_ARRAY_BUFFER, (triangleCount + lineCount) * sizeof(DebugVertex), NULL, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, triangleCount * sizeof(DebugVertex), batch.triangles.data());
+            glBufferSubData(GL_ARRAY_BUFFER, triangleCount * sizeof(DebugVertex), lineCount * sizeof(DebugVertex), batch.lines.data());
+
+            glUseProgram(shader);
+            glUniformMatrix4fv(worldMatrixLocation, 1, GL_FALSE, glm::value_ptr(worldMatrix));
+            enableBlending();
+            if (triangleCount) glDrawArrays(GL_TRIANGLES, 0, triangleCount);
+            if (lineCount) glDrawArrays(GL_LINES, triangleCount, lineCount);
+            glDisable(GL_BLEND);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glBindVertexArray(0);
+        }
+        ticks += SDL_GetPerformanceCounter() - start;
+    }
+
+    void logStats() const {
+        if (frames == 0) return;
+        SDL_Log("Debug draw: %llu frames, %.0f vertices and %.3f ms collecting, uploading and issuing the draws per frame",
+            (unsigned long long)frames, (double)vertices / frames, ticks * 1000.0 / SDL_GetPerformanceFrequency() / frames);
     }
-private:
-    const int segments = 100;
-    float vertices[100+1][2];
+};
+
+// Any body the simulation spawned, whatever shape it has. ShapeRenderer draws it
+struct Circle
+{
+    Circle(glm::vec3 color, int radius, glm::vec2 pos, PhysicsWorld& physics, Uint16 category = CATEGORY_CIRCLE,
+           ShapeType shape = SHAPE_CIRCLE, int sides = 0)
+        : radius(radius), category(category), shape(shape), sides((Uint8)sides), position(pos) {
+        setupPhysics(physics);
+
+        normColor.r = color.r / 255;
+        normColor.g = color.g / 255;
+        normColor.b = color.b / 255;
+    }
+    void setupPhysics(PhysicsWorld& world) {
+        physics = &world;
+        b2Vec2 center(position.x / PIXELS_PER_METER, position.y / PIXELS_PER_METER);
+        if (shape == SHAPE_CIRCLE) body = world.createCircle(center, radius / PIXELS_PER_METER, category);
+        else body = world.createShape(center, { shape, radius / PIXELS_PER_METER, sides }, category);
+    }
+    void applyForce(b2Vec2 force) {
+        physics->applyForce(body, force);
+    }
+    void draw(ShapeRenderer& renderer) const {
+        renderer.add(shape, sides, physics->getPosition(body), physics->getAngle(body), radius / PIXELS_PER_METER, normColor);
+    }
+    PhysicsWorld* physics;
+    int body;
     glm::vec3 normColor;
-    glm::vec2 position;
-    GLuint VAO, VBO;
-    b2Body* body;
     int radius;
+    Uint16 category;
+    ShapeType shape;
+    Uint8 sides;
+    glm::vec2 position; // Where it spawned, in pixels
+    bool soft = false;  // Part of a blob
 };
 
-struct Wall
+// Everything that has to advance identically in the live overlay, offline
+// renders and replays. Spawns and forces are applied as events before the
+// world step they are keyed to, either generated on the spawn timer or read
+// back from a recorded log
+struct Simulation
 {
-    b2Body* body;
-    Wall(glm::vec2 pos, glm::vec2 size, b2World& world) {
-        b2BodyDef groundBodyDef;
-        groundBodyDef.position.Set(pos.x / 48.0f, pos.y / 48.0f);
+    PhysicsWorld* physics;
+    RandomStreams rng;
+    std::vector<Circle*> circles;
+    std::vector<SimEvent> spawned; // Spawns of the last step, for their sounds
+    EventLog* recording = NULL;
+    const EventLog* playback = NULL;
+    SolverGovernor* governor = NULL; // Fixed solver quality when not set
+    AttractorField* attractors = NULL;
+    CursorInteraction* cursor = NULL;
+    PhysicsLod* lod = NULL;
+    ContinuousPolicy* continuous = NULL;
+    TreeMonitor* tree = NULL;
+    SoftBodies* soft = NULL;
+    size_t playbackCursor = 0;
+    Uint32 stepIndex = 0;
+    SpawnScheduler spawner;
+    SpawnBatch batch;
+    float cursorX = 0.0f, cursorY = 0.0f; // Pixels
+    CursorMode cursorMode = CURSOR_OFF;
+    Uint8 shapes = SHAPES_CIRCLES_ONLY; // What the spawn timer and bursts create
+
+    // Takes ownership of the physics world and of every optional part once set
+    Simulation(Uint64 seed, PhysicsWorld* physics) : physics(physics), rng(seed), spawner(100.0f) {
+        circles.reserve(MAX_CIRCLES);
+    }
+    ~Simulation() {
+        for (Circle* circle : circles) delete circle;
+        delete physics;
+        delete attractors;
+        delete cursor;
+        delete lod;
+        delete continuous;
+        delete tree;
+        delete soft;
+    }
+
+    SpawnDistribution screenSpawns() const {
+        SpawnDistribution distribution(50.0f, 50.0f, WINDOW_WIDTH - 50.0f, WINDOW_HEIGHT - 50.0f);
+        distribution.shapes = shapes;
+        return distribution;
+    }
+
+    // Creates count circles in one go. Room for all of them is reserved up
+    // front and their random numbers are drawn in bulk, then the spawn events
+    // go through apply one after another like single ones
+    void spawn(int count, const SpawnDistribution& distribution) {
+        if (count <= 0) return;
+        batch.generate(count, distribution, rng.spawn, rng.color);
+        size_t total = circles.size() + count;
+        if (circles.capacity() < total) {
+            reserveFor(circles, total);
+            physics->reserve((int)circles.capacity());
+        }
+        if (recording) reserveFor(recording->events, recording->events.size() + count);
+        for (int i = 0; i < count; i++) {
+            SimEvent event = {};
+            event.type = EVENT_SPAWN;
+            event.x = batch.x[i];
+            event.y = batch.y[i];
+            event.forceX = (float)batch.forceX[i];
+            event.forceY = (float)batch.forceY[i];
+            event.radius = (Uint8)batch.radius[i];
+            event.red = (Uint8)batch.red[i];
+            event.green = (Uint8)batch.green[i];
+            event.blue = (Uint8)batch.blue[i];
+            event.category = distribution.category;
+            event.shape = (Uint8)batch.shape[i];
+            event.sides = (Uint8)batch.sides[i];
+            apply(event);
+        }
+    }
+
+    // Rings of soft circles 30 to 60 pixels across, their particles just
+    // touch. They don't go through apply, so a replay wouldn't have them
+    void spawnBlobs(int count) {
+        if (count <= 0 || !soft) return;
+        SpawnDistribution distribution(110.0f, 110.0f, WINDOW_WIDTH - 110.0f, WINDOW_HEIGHT - 110.0f);
+        distribution.minRadius = 30;
+        distribution.maxRadius = 60;
+        batch.generate(count, distribution, rng.spawn, rng.color);
+        int particles = SDL_clamp(soft->settings.blobParticles, MIN_BLOB_PARTICLES, MAX_BLOB_PARTICLES);
+        reserveFor(circles, circles.size() + count * particles);
+        physics->reserve((int)circles.capacity());
+        for (int b = 0; b < count; b++) {
+            float ring = (float)batch.radius[b];
+            int radius = SDL_max((int)(ring * sinf(float(M_PI) / particles)), 2);
+            glm::vec3 color((float)batch.red[b], (float)batch.green[b], (float)batch.blue[b]);
+            int first = (int)circles.size();
+            for (int i = 0; i < particles; i++) {
+                float theta = 2.0f * float(M_PI) * i / particles;
+                Circle* circle = new Circle(color, radius, glm::vec2(batch.x[b] + ring * cosf(theta), batch.y[b] + ring * sinf(theta)), *physics);
+                circle->soft = true;
+                circles.push_back(circle);
+            }
+            soft->addBlob(*physics, circles[first]->body, particles);
+        }
+    }
+
+    void apply(SimEvent event) {
+        event.step = stepIndex;
+        if (recording) recording->push(event);
+        switch (event.type) {
+        case EVENT_SPAWN: {
+            glm::vec3 color(event.red, event.green, event.blue);
+            Circle* circle = new Circle(color, event.radius, glm::vec2(event.x, event.y), *physics, event.category, (ShapeType)event.shape, event.sides);
+            circle->applyForce(b2Vec2(event.forceX, event.forceY));
+            circles.push_back(circle);
+            if (soft && soft->wantsRope() && event.category == CATEGORY_CIRCLE)
+                soft->addRope(*physics, circle->body, b2Color(circle->normColor.r, circle->normColor.g, circle->normColor.b));
+            spawned.push_back(event);
+            break;
+        }
+        case EVENT_WELL:
+            if (!attractors) break;
+            attractors->wellActive = true;
+            attractors->wellX = event.x / PIXELS_PER_METER;
+            attractors->wellY = event.y / PIXELS_PER_METER;
+            break;
+        case EVENT_CURSOR:
+            cursorX = event.x;
+            cursorY = event.y;
+            if (event.cursorMode != CURSOR_EXPLODE) cursorMode = (CursorMode)event.cursorMode;
+            if (lod) lod->setFocus(cursorX / PIXELS_PER_METER, cursorY / PIXELS_PER_METER, cursorMode != CURSOR_OFF);
+            if (!cursor) break;
+            cursor->x = cursorX / PIXELS_PER_METER;
+            cursor->y = cursorY / PIXELS_PER_METER;
+            if (event.cursorMode == CURSOR_EXPLODE) cursor->explosionPending = true;
+            else cursor->mode = cursorMode;
+            break;
+        }
+    }
+
+    // Moves the gravity well, only recorded when it actually moved
+    void setWell(float x, float y) {
+        if (!attractors || attractors->settings.wellStrength == 0.0f) return;
+        if (attractors->wellActive && attractors->wellX == x / PIXELS_PER_METER && attractors->wellY == y / PIXELS_PER_METER) return;
+        SimEvent event = {};
+        event.type = EVENT_WELL;
+        event.x = x;
+        event.y = y;
+        apply(event);
+    }
+
+    // Moves the cursor or changes what it does, only recorded when something
+    // changed. An explosion goes off on the next step. The LOD focus follows
+    // the cursor too
+    void setCursor(float x, float y, CursorMode mode, bool explode) {
+        if (!cursor && !(lod && lod->settings.focusRadius > 0.0f)) return;
+        SimEvent event = {};
+        event.type = EVENT_CURSOR;
+        event.x = x;
+        event.y = y;
+        if (explode) {
+            event.cursorMode = CURSOR_EXPLODE;
+            apply(event);
+        }
+        if (cursorMode == mode && (mode == CURSOR_OFF || (cursorX == x && cursorY == y))) return;
+        event.cursorMode = mode;
+        apply(event);
+    }
+
+    void applyAttractors() {
+        int count = (int)circles.size();
+        attractors->resize(count);
+        for (int i = 0; i < count; i++) {
+            b2Vec2 position = physics->getPosition(circles[i]->body);
+            float r = circles[i]->radius / PIXELS_PER_METER;
+            attractors->x[i] = position.x;
+            attractors->y[i] = position.y;
+            attractors->mass[i] = CIRCLE_DENSITY * float(M_PI) * r * r;
+        }
+        attractors->computeForces(attractors->x.data(), attractors->y.data(), attractors->mass.data(), count,
+            attractors->forceX.data(), attractors->forceY.data());
+        for (int i = 0; i < count; i++) physics->applyForce(circles[i]->body, b2Vec2(attractors->forceX[i], attractors->forceY[i]));
+    }
+
+    // Returns false once a played back log has ended
+    bool step(float deltaTime) {
+        spawned.clear();
+        if (playback) {
+            const std::vector<SimEvent>& events = playback->events;
+            for (; playbackCursor < events.size() && events[playbackCursor].step == stepIndex; playbackCursor++) {
+                if (events[playbackCursor].type == EVENT_END) return false;
+                apply(events[playbackCursor]);
+            }
+        }
+        else {
+            int due = spawner.due(deltaTime);
+            spawn(SDL_min(due, MAX_CIRCLES - (int)circles.size()), screenSpawns());
+        }
+        if (attractors) applyAttractors();
+        if (cursor) cursor->apply(*physics, deltaTime);
+        if (lod) lod->update(*physics, (int)circles.size(), deltaTime);
+        if (continuous) continuous->update(*physics, (int)circles.size(), deltaTime);
+        Uint64 start = SDL_GetPerformanceCounter();
+        if (governor) governor->step(*physics, deltaTime);
+        else physics->step(deltaTime);
+        if (tree) tree->afterStep(*physics, (float)((SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency()));
+        if (continuous) continuous->checkEscapes(*physics, (int)circles.size());
+        if (soft) soft->update(*physics, deltaTime);
+        stepIndex++;
+        return true;
+    }
+
+    void recordKey(SDL_Keycode key) {
+        if (!recording) return;
+        SimEvent event = {};
+        event.type = EVENT_KEY;
+        event.step = stepIndex;
+        event.key = key;
+        recording->push(event);
+    }
+
+    void endRecording() {
+        if (!recording) return;
+        SimEvent event = {};
+        event.type = EVENT_END;
+        event.step = stepIndex;
+        event.hash = stateHash();
+        recording->push(event);
+    }
+
+    // Decorative circles are left out, they are gone by the next run, and so
+    // are blobs, a snapshot has no joints to hold them together
+    void takeSnapshot(std::vector<SnapshotBody>& bodies) const {
+        bodies.clear();
+        bodies.reserve(circles.size());
+        for (size_t i = 0; i < circles.size(); i++) {
+            if (circles[i]->category == CATEGORY_DECOR || circles[i]->soft) continue;
+            BodyState state = physics->getState(circles[i]->body);
+            bodies.emplace_back();
+            SnapshotBody& out = bodies.back();
+            out.x = state.position.x;
+            out.y = state.position.y;
+            out.angle = state.angle;
+            out.velocityX = state.velocity.x;
+            out.velocityY = state.velocity.y;
+            out.angularVelocity = state.angularVelocity;
+            out.radius = (float)circles[i]->radius;
+            out.red = (Uint8)SDL_lroundf(circles[i]->normColor.r * 255);
+            out.green = (Uint8)SDL_lroundf(circles[i]->normColor.g * 255);
+            out.blue = (Uint8)SDL_lroundf(circles[i]->normColor.b * 255);
+            out.awake = state.awake;
+            out.shape = circles[i]->shape;
+            out.sides = circles[i]->sides;
+        }
+    }
 
-        b2PolygonShape groundBox;
-        groundBox.SetAsBox(0.5f * size.x / 48.0f, 0.5f * size.y / 48.0f);
+    // Recreates the snapshotted bodies in a single pass over the array.
+    // Positions are clamped in case the screen got smaller since
+    void restore(const SnapshotBody* bodies, Uint32 count) {
+        circles.reserve(circles.size() + count);
+        for (Uint32 i = 0; i < count; i++) {
+            const SnapshotBody& in = bodies[i];
+            glm::vec2 position(SDL_clamp(in.x * PIXELS_PER_METER, in.radius, WINDOW_WIDTH - in.radius),
+                               SDL_clamp(in.y * PIXELS_PER_METER, in.radius, WINDOW_HEIGHT - in.radius));
+            Circle* circle = new Circle(glm::vec3(in.red, in.green, in.blue), (int)in.radius, position, *physics, CATEGORY_CIRCLE,
+                (ShapeType)SDL_min(in.shape, SHAPE_TYPE_COUNT - 1), in.sides);
+            BodyState state = physics->getState(circle->body);
+            state.angle = in.angle;
+            state.velocity.Set(in.velocityX, in.velocityY);
+            state.angularVelocity = in.angularVelocity;
+            state.awake = in.awake != 0;
+            physics->setState(circle->body, state);
+            circles.push_back(circle);
+        }
+    }
 
-        body = world.CreateBody(&groundBodyDef);
-        body->CreateFixture(&groundBox, 0.0f);
+    Uint64 stateHash() const {
+        Uint64 hash = HASH_SEED;
+        for (Circle* circle : circles) {
+            BodyState state = physics->getState(circle->body);
+            hashBytes(hash, &state.position, sizeof(state.position));
+            hashBytes(hash, &state.angle, sizeof(state.angle));
+            hashBytes(hash, &state.velocity, sizeof(state.velocity));
+        }
+        return hash;
     }
 };
 
-Mix_Chunk** initAudio(const int NUM_AUDIOS)
+// Rope particles are drawn with the bodies as small circles, all but the
+// first, which sits on the anchor
+void drawRopes(const Simulation& sim, ShapeRenderer& renderer)
 {
-    char filename[100];
-    Mix_Chunk** audios = new Mix_Chunk * [NUM_AUDIOS];
+    for (const SoftRope* rope : sim.soft->ropes)
+    {
+        glm::vec3 color(rope->color.r, rope->color.g, rope->color.b);
+        for (int i = 1; i < (int)rope->points.size(); i++)
+            renderer.add(SHAPE_CIRCLE, 0, sim.soft->ropePoint(*sim.physics, *rope, i), 0.0f, ROPE_PARTICLE_RADIUS, color);
+    }
+}
 
+// Plays the impacts of the circles spawned in the last step, up to
+// MAX_SPAWN_SOUNDS of them. windowX is the
+// window's left edge on the virtual desktop, used for panning
+void playSpawnSounds(Simulation& sim, Mixer* mixer, Mix_Chunk** audios, int windowX)
+{
+    for (size_t i = 0; i < sim.spawned.size() && i < MAX_SPAWN_SOUNDS; i++)
+    {
+        const SimEvent& event = sim.spawned[i];
+        float pan = (windowX + event.x - DESKTOP_LEFT) / DESKTOP_WIDTH;
+        float force = b2Vec2(event.forceX, event.forceY).Length();
+        float gain = impactGain(force, 1000.0f, (float)event.radius, 25.0f);
+        if (audios) mixer->play(audios[sim.rng.audio.range(0, NUM_AUDIOS - 1)], pan, gain);
+        else mixer->strike(pan, (float)event.radius, gain);
+    }
+}
+
+void initAudio()
+{
     if (Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 1024) < 0)
     {
         SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "SDL_mixer initialization failed", Mix_GetError(), NULL);
     }
+}
+
+// Loads the plops embedded in the executable, or from the audio directory when
+// external is set so they can be swapped out without rebuilding
+Mix_Chunk** loadAudios(const int NUM_AUDIOS, bool external)
+{
+    char filename[100];
+    Mix_Chunk** audios = new Mix_Chunk * [NUM_AUDIOS];
+
     for (int i = 0; i < NUM_AUDIOS; ++i)
     {
         snprintf(filename, sizeof(filename), "audio/plop_%02d.wav", i + 1);
-        audios[i] = Mix_LoadWAV(filename);
+        if (external)
+        {
+            audios[i] = Mix_LoadWAV(filename);
+        }
+        else
+        {
+            HRSRC resource = FindResource(NULL, MAKEINTRESOURCE(IDR_PLOP_FIRST + i), RT_RCDATA);
+            HGLOBAL data = resource ? LoadResource(NULL, resource) : NULL;
+            audios[i] = data ? Mix_LoadWAV_RW(SDL_RWFromConstMem(LockResource(data), SizeofResource(NULL, resource)), 1) : NULL;
+        }
         if (!audios[i])
         {
             SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Failed to load audio file", filename, NULL);
         }
     }
-    Mix_Volume(-1, MIX_MAX_VOLUME / 4);
     return audios;
 }
 
-struct BatchRenderer
+bool hasArg(int argc, char* argv[], const char* name)
 {
-    GLint projectionMatrixUniform;
-    GLint vertexColorUniform;
-    GLuint shader, VAO, VBO;
-    glm::mat4 orthoMatrix;
-    glm::vec2* vertices;
-    int vertexCapacity;
-    int vertexCount;
+    for (int i = 1; i < argc; i++)
+    {
+        if (SDL_strcmp(argv[i], name) == 0) return true;
+    }
+    return false;
+}
 
-    BatchRenderer(int vertexCapacity) : vertexCapacity(vertexCapacity), vertexCount(0) {
-        glGenVertexArrays(1, &VAO);
-        glBindVertexArray(VAO);
+const char* argValue(int argc, char* argv[], const char* name, const char* fallback)
+{
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (SDL_strcmp(argv[i], name) == 0) return argv[i + 1];
+    }
+    return fallback;
+}
 
-        glGenBuffers(1, &VBO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * vertexCapacity, NULL, GL_DYNAMIC_DRAW);
+// Flags that change how the world behaves. A recording keeps them, so its
+// replay runs the same world whatever the replay's own command line says
+const char* const REPLAYED_FLAGS[] = { "--physics", "--well", "--gravity", "--edge-repulsion", "--theta",
+                                       "--cursor", "--lod", "--lod-focus", "--ccd", "--ccd-fraction" };
+
+bool isReplayedFlag(const char* arg)
+{
+    for (const char* flag : REPLAYED_FLAGS)
+    {
+        if (SDL_strcmp(arg, flag) == 0) return true;
+    }
+    return false;
+}
 
-        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec2), (void*)0);
+// Splits the command line into the replayed flags, each followed by its value
+// when it has one, and everything else
+void splitReplayedFlags(int argc, char* argv[], std::vector<std::string>& replayed, std::vector<std::string>& rest)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        bool flag = isReplayedFlag(argv[i]);
+        (flag ? replayed : rest).push_back(argv[i]);
+        if (flag && i + 1 < argc && SDL_strncmp(argv[i + 1], "--", 2) != 0) replayed.push_back(argv[++i]);
+    }
+}
 
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
+// --physics circles picks the SoA circle engine, Box2D is the default.
+// --threads sets how many threads the circle engine solves with
+PhysicsWorld* createPhysics(int argc, char* argv[])
+{
+    int threads = SDL_atoi(argValue(argc, argv, "--threads", "1"));
+    if (SDL_strcmp(argValue(argc, argv, "--physics", "box2d"), "circles") == 0) return new CircleWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT, threads);
+    return new Box2DWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT);
+}
 
-        shader = initShaders((char*)vertexSource2D, (char*)fragmentSource2D);
+// --well, --gravity and --edge-repulsion turn on the cursor well, mutual
+// attraction and the push away from the screen edges. A replay needs the same
+// flags as its recording
+AttractorField* createAttractors(int argc, char* argv[])
+{
+    AttractorSettings settings;
+    settings.wellStrength = (float)SDL_atof(argValue(argc, argv, "--well", "0"));
+    settings.mutualStrength = (float)SDL_atof(argValue(argc, argv, "--gravity", "0"));
+    settings.edgeStrength = (float)SDL_atof(argValue(argc, argv, "--edge-repulsion", "0"));
+    settings.theta = (float)SDL_atof(argValue(argc, argv, "--theta", "0.5"));
+    AttractorField* attractors = new AttractorField(settings, WINDOW_WIDTH / PIXELS_PER_METER, WINDOW_HEIGHT / PIXELS_PER_METER,
+        SDL_atoi(argValue(argc, argv, "--threads", "1")));
+    if (attractors->enabled()) return attractors;
+    delete attractors;
+    return NULL;
+}
 
-        projectionMatrixUniform = glGetUniformLocation(shader, "projectionMatrix");
-        vertexColorUniform = glGetUniformLocation(shader, "vertexColor");
-        orthoMatrix = glm::ortho(-ASPECT_RATIO, ASPECT_RATIO, -1.0f, 1.0f, -1.0f, 1.0f);
-        vertices = new glm::vec2[vertexCapacity];
+// --shapes [list] mixes boxes, polygons and capsules in with the circles, or
+// spawns only the comma separated ones of circle, box, polygon and capsule.
+// The circle engine has nothing but circles
+Uint8 createShapes(int argc, char* argv[])
+{
+    if (!hasArg(argc, argv, "--shapes")) return SHAPES_CIRCLES_ONLY;
+    if (SDL_strcmp(argValue(argc, argv, "--physics", "box2d"), "circles") == 0)
+    {
+        SDL_Log("--shapes is ignored by the circle engine");
+        return SHAPES_CIRCLES_ONLY;
+    }
+    const char* names[SHAPE_TYPE_COUNT] = { "circle", "box", "polygon", "capsule" };
+    const char* list = argValue(argc, argv, "--shapes", "circle,box,polygon,capsule");
+    Uint8 shapes = 0;
+    for (int type = 0; type < SHAPE_TYPE_COUNT; type++)
+    {
+        if (SDL_strstr(list, names[type])) shapes |= 1 << type;
     }
+    return shapes ? shapes : (Uint8)((1 << SHAPE_TYPE_COUNT) - 1);
+}
 
-    void Render() {
-        glUseProgram(shader);
-        glUniform4f(vertexColorLocation, 1.0f, 0.0f, 1.0f, 1.0f);
-        glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, glm::value_ptr(orthoMatrix));
+// --cursor lets circles react to the mouse. A replay needs it too when the
+// recording had it
+CursorInteraction* createCursor(int argc, char* argv[])
+{
+    if (!hasArg(argc, argv, "--cursor")) return NULL;
+    return new CursorInteraction(CursorSettings());
+}
 
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(glm::vec2) * vertexCount, vertices);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+// Reads the cursor and the hotkeys without keyboard focus, which the overlay
+// never gets. Ctrl+Shift grabs while held and Space explodes while grabbing.
+// Off the screen the cursor does nothing
+void updateCursor(Simulation& sim, int windowX, int windowY, bool& explodeWasDown)
+{
+    int mouseX, mouseY;
+    SDL_GetGlobalMouseState(&mouseX, &mouseY);
+    float x = (float)(mouseX - windowX), y = (float)(mouseY - windowY);
+    sim.setWell(x, y);
 
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLE_FAN, 0, vertexCount);
-        glBindVertexArray(0);
+    bool grab = (GetAsyncKeyState(VK_CONTROL) & 0x8000) && (GetAsyncKeyState(VK_SHIFT) & 0x8000);
+    bool explodeDown = grab && (GetAsyncKeyState(VK_SPACE) & 0x8000);
+    bool onScreen = x >= 0 && y >= 0 && x < WINDOW_WIDTH && y < WINDOW_HEIGHT;
+    CursorMode mode = !onScreen ? CURSOR_OFF : grab ? CURSOR_GRAB : CURSOR_PUSH;
+    sim.setCursor(x, y, mode, onScreen && explodeDown && !explodeWasDown);
+    explodeWasDown = explodeDown;
+}
 
-        vertexCount = 0;
+// What each of --debug-draw's names and Ctrl+Alt+1 to 4 turn on. Joints go
+// with the shapes they hold together
+const char* DEBUG_DRAW_NAMES[] = { "shapes", "aabbs", "contacts", "centers" };
+const Uint32 DEBUG_DRAW_FLAGS[] = { b2Draw::e_shapeBit | b2Draw::e_jointBit, b2Draw::e_aabbBit, b2Draw::e_pairBit, b2Draw::e_centerOfMassBit };
+const int DEBUG_DRAW_LAYERS = 4;
+
+// --debug-draw [list] starts with the comma separated ones of shapes, aabbs,
+// contacts and centers drawn over the scene, or all of them
+Uint32 debugDrawFlags(int argc, char* argv[])
+{
+    if (!hasArg(argc, argv, "--debug-draw")) return 0;
+    const char* list = argValue(argc, argv, "--debug-draw", "shapes,aabbs,contacts,centers");
+    Uint32 flags = 0, all = 0;
+    for (int layer = 0; layer < DEBUG_DRAW_LAYERS; layer++)
+    {
+        if (SDL_strstr(list, DEBUG_DRAW_NAMES[layer])) flags |= DEBUG_DRAW_FLAGS[layer];
+        all |= DEBUG_DRAW_FLAGS[layer];
     }
+    return flags ? flags : all;
+}
 
-    void PushVertex(glm::vec2 vertex) {
-        vertices[vertexCount++] = vertex;
+// Ctrl+Alt+1 to 4 toggle the debug draw layers, once per press
+void updateDebugDraw(b2Draw& draw, bool wasDown[DEBUG_DRAW_LAYERS])
+{
+    bool held = (GetAsyncKeyState(VK_CONTROL) & 0x8000) && (GetAsyncKeyState(VK_MENU) & 0x8000);
+    for (int layer = 0; layer < DEBUG_DRAW_LAYERS; layer++)
+    {
+        bool down = held && (GetAsyncKeyState('1' + layer) & 0x8000);
+        if (down && !wasDown[layer])
+        {
+            if (draw.GetFlags() & DEBUG_DRAW_FLAGS[layer]) draw.ClearFlags(DEBUG_DRAW_FLAGS[layer]);
+            else draw.AppendFlags(DEBUG_DRAW_FLAGS[layer]);
+        }
+        wasDown[layer] = down;
     }
-};
+}
 
-int main(int argc, char* argv[])
+// Ctrl+Alt+Up speeds the simulation up to the next time scale and
+// Ctrl+Alt+Down slows it down, once per press
+void updateTimeScale(TimeScale& timeScale, bool& fasterWasDown, bool& slowerWasDown)
 {
-    SDL_Window* window          = SDL_CreateWindow("OpenGL", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_BORDERLESS);
-    HWND        hwnd            = initTransparency(window);
-    HDC         hdc             = initOpenGL(hwnd);
-    GLuint      shaderProgram   = initShaders((char*)vertexSource2D, (char*)fragmentSource2D);
-    Mix_Chunk** audios          = initAudio(NUM_AUDIOS);
+    bool held = (GetAsyncKeyState(VK_CONTROL) & 0x8000) && (GetAsyncKeyState(VK_MENU) & 0x8000);
+    bool fasterDown = held && (GetAsyncKeyState(VK_UP) & 0x8000);
+    bool slowerDown = held && (GetAsyncKeyState(VK_DOWN) & 0x8000);
+    if (fasterDown && !fasterWasDown) timeScale.change(true);
+    if (slowerDown && !slowerWasDown) timeScale.change(false);
+    fasterWasDown = fasterDown;
+    slowerWasDown = slowerDown;
+}
 
-    // Set up orthographic view, we only do this once because the view wont get changed
-    projectionMatrixLocation = glGetUniformLocation(shaderProgram, "projectionMatrix");
-    vertexColorLocation = glGetUniformLocation(shaderProgram, "vertexColor");
-    orthoMatrix = glm::ortho(-ASPECT_RATIO, ASPECT_RATIO, -1.0f, 1.0f, -1.0f, 1.0f);
+// --lod steps slow bodies at a lower rate and freezes resting ones.
+// --lod-focus keeps full detail within that many pixels of the cursor
+PhysicsLod* createLod(int argc, char* argv[])
+{
+    if (!hasArg(argc, argv, "--lod")) return NULL;
+    LodSettings settings;
+    settings.focusRadius = (float)SDL_atof(argValue(argc, argv, "--lod-focus", "0")) / PIXELS_PER_METER;
+    return new PhysicsLod(settings);
+}
 
-    b2World world({ 0.0f, 0.0f });
+// --ccd picks continuous collision: always like Box2D does by default, off,
+// or adaptive for only the bodies fast enough to tunnel. --ccd-fraction is
+// how much of its radius a body has to move in a step to count as fast
+ContinuousPolicy* createContinuous(int argc, char* argv[])
+{
+    const char* mode = argValue(argc, argv, "--ccd", NULL);
+    if (!mode) return NULL;
+    ContinuousMode continuousMode = SDL_strcmp(mode, "off") == 0 ? CCD_OFF : SDL_strcmp(mode, "adaptive") == 0 ? CCD_ADAPTIVE : CCD_ALWAYS;
+    return new ContinuousPolicy(continuousMode, (float)SDL_atof(argValue(argc, argv, "--ccd-fraction", "0.5")),
+        WINDOW_WIDTH / PIXELS_PER_METER, WINDOW_HEIGHT / PIXELS_PER_METER);
+}
 
-    Wall(glm::vec2(WINDOW_WIDTH / 2, WINDOW_HEIGHT + 5), glm::vec2(WINDOW_WIDTH, 10), world);
-    Wall(glm::vec2(WINDOW_WIDTH / 2, -5), glm::vec2(WINDOW_WIDTH, 10), world);
-    Wall(glm::vec2(-5, WINDOW_HEIGHT / 2), glm::vec2(10, WINDOW_HEIGHT), world);
-    Wall(glm::vec2(WINDOW_WIDTH + 5, WINDOW_HEIGHT / 2), glm::vec2(10, WINDOW_HEIGHT), world);
+// --fluid <count> drops a block of fluid particles in the middle of the screen
+ParticleFluid* createFluid(int argc, char* argv[])
+{
+    int count = SDL_atoi(argValue(argc, argv, "--fluid", "0"));
+    if (count <= 0) return NULL;
+    FluidSettings settings;
+    ParticleFluid* fluid = new ParticleFluid(settings, WINDOW_WIDTH / PIXELS_PER_METER, WINDOW_HEIGHT / PIXELS_PER_METER,
+        SDL_atoi(argValue(argc, argv, "--threads", "1")));
+    fluid->spawnBlock(count, 0.5f * WINDOW_WIDTH / PIXELS_PER_METER);
+    return fluid;
+}
 
-    const int circles_size = 1000;
-    Circle* circles[circles_size] { 0 };
-    size_t circles_position = 0;
+// The circles are where the world step just left them
+void stepFluid(const Simulation& sim, ParticleFluid& fluid, float deltaTime)
+{
+    fluid.obstacles.clear();
+    for (const Circle* circle : sim.circles)
+    {
+        b2Vec2 position = sim.physics->getPosition(circle->body);
+        fluid.obstacles.push_back({ position.x, position.y, circle->radius / PIXELS_PER_METER });
+    }
+    fluid.step(deltaTime);
+}
 
-    SDL_Event windowEvent;
-    float timePassed = 0.0f;
-    Uint32 prevTicks = SDL_GetTicks();
+// --tree-monitor samples the broadphase tree, --tree-rebuild [factor] also
+// rebuilds it once its quality is that many times worse than a fresh one's.
+// --tree-log writes the samples to a CSV file at exit
+TreeMonitor* createTreeMonitor(int argc, char* argv[], bool deterministic)
+{
+    bool rebuild = hasArg(argc, argv, "--tree-rebuild");
+    if (!rebuild && !hasArg(argc, argv, "--tree-monitor") && !hasArg(argc, argv, "--tree-log")) return NULL;
+    // When a rebuild fits depends on the frame times, and it changes the contact order
+    if (rebuild && deterministic)
+    {
+        SDL_Log("--tree-rebuild is ignored in deterministic mode");
+        rebuild = false;
+    }
+    return new TreeMonitor(rebuild ? (float)SDL_atof(argValue(argc, argv, "--tree-rebuild", "1.3")) : 0.0f);
+}
 
-    while (true)
+// --blobs N drops soft rings of --blob-particles circles each, --ropes N
+// hangs a rope of --rope-segments from each of the next N circles spawned.
+// --soft-budget caps how many of them are simulated at once, and
+// --soft-iterations how many solver iterations a rope gets per step
+SoftBodies* createSoft(int argc, char* argv[], bool deterministic)
+{
+    SoftSettings settings;
+    settings.blobs = SDL_atoi(argValue(argc, argv, "--blobs", "0"));
+    settings.blobParticles = SDL_atoi(argValue(argc, argv, "--blob-particles", "12"));
+    settings.ropes = SDL_atoi(argValue(argc, argv, "--ropes", "0"));
+    settings.ropeSegments = SDL_atoi(argValue(argc, argv, "--rope-segments", "12"));
+    settings.budget = SDL_atoi(argValue(argc, argv, "--soft-budget", "16"));
+    settings.iterations = SDL_atoi(argValue(argc, argv, "--soft-iterations", "4"));
+    if (settings.blobs > 0 && SDL_strcmp(argValue(argc, argv, "--physics", "box2d"), "circles") == 0)
     {
-        Uint32 currentTicks = SDL_GetTicks();
-        float deltaTime = (currentTicks - prevTicks) / 1000.0f; // deltaTime in seconds
-        prevTicks = currentTicks;
-        timePassed += deltaTime;
-        
-        if (SDL_PollEvent(&windowEvent))
-        {
-            if (windowEvent.type == SDL_QUIT) break;
-        }
-        if (deltaTime < 1.0f / 60) {
-            world.Step(deltaTime, 6, 2);
-        }
-        if (circles_position < circles_size && timePassed > 0.01f)
-        {
-            glm::vec2   randomPosition(randomNum(50, WINDOW_WIDTH - 50), randomNum(50, WINDOW_HEIGHT - 50));
-            glm::vec3   randomColor(randomNum(0, 255), randomNum(0, 255), randomNum(0, 255));
-            b2Vec2      randomForce((float)randomNum(-1000, 1000), (float)randomNum(-1000, 1000));
-            int         randomRadius = randomNum(5, 25);
-            int         randomAudio = randomNum(0, NUM_AUDIOS-1);
+        SDL_Log("--blobs is ignored by the circle engine, it has no joints");
+        settings.blobs = 0;
+    }
+    if (settings.blobs > 0 && deterministic)
+    {
+        SDL_Log("--blobs is ignored in deterministic mode");
+        settings.blobs = 0;
+    }
+    if (settings.blobs <= 0 && settings.ropes <= 0) return NULL;
+    return new SoftBodies(settings);
+}
 
-            circles[circles_position] = new Circle(randomColor, randomRadius, randomPosition, world);
-            circles[circles_position]->applyForce(randomForce);
-            Mix_PlayChannel(-1, audios[randomAudio], 0);
+// Simulates a scenario ahead on its own thread and fills a trajectory cache
+// with it. The simulation is its own, nothing else touches it while the
+// thread runs. Keyframes go in every stepsPerFrame fixed steps
+struct CacheRecorder
+{
+    Simulation* sim;
+    TrajectoryCache* cache;
+    const char* savePath;
+    std::atomic<bool> quit;
+    Uint64 ticks = 0;
+    std::thread thread;
 
-            timePassed = 0.0f;
-            circles_position++;
-        }
+    CacheRecorder(Simulation* sim, TrajectoryCache* cache, const char* savePath) : sim(sim), cache(cache), savePath(savePath), quit(false) {
+        thread = std::thread(&CacheRecorder::run, this);
+    }
+    ~CacheRecorder() {
+        quit = true;
+        thread.join();
+        delete sim;
+    }
+
+    void run() {
+        Uint64 start = SDL_GetPerformanceCounter();
+        const float stepTime = 1.0f / cache->stepRate;
+        Uint32 frameCount = (Uint32)cache->frames.size();
+        for (Uint32 frame = 0; frame < frameCount && !quit; frame++)
+        {
+            for (int s = 0; s < cache->stepsPerFrame; s++) sim->step(stepTime);
+            for (size_t i = cache->bodies.size(); i < sim->circles.size(); i++)
+            {
+                const Circle* circle = sim->circles[i];
+                glm::vec3 color = circle->normColor * 255.0f + 0.5f;
+                cache->addBody({ frame, (Uint8)circle->radius, (Uint8)color.r, (Uint8)color.g, (Uint8)color.b });
+            }
+            cache->capture(*sim->physics, (int)sim->circles.size());
+        }
+        ticks = SDL_GetPerformanceCounter() - start;
+        if (quit) return;
+        cache->complete = true;
+        if (savePath && !cache->save(savePath)) SDL_Log("Failed to save %s", savePath);
+    }
+};
+
+// --cache-ahead <seconds> simulates that much of the scenario in the
+// background and plays it back instead of stepping live, with keyframes at
+// --cache-rate per second. --cache-save writes the cache once it is done,
+// --cache-load plays one back that was saved before
+TrajectoryPlayer* createPlayback(int argc, char* argv[], Uint64 seed, CacheRecorder*& recorder)
+{
+    recorder = NULL;
+    const char* loadPath = argValue(argc, argv, "--cache-load", NULL);
+    if (loadPath)
+    {
+        TrajectoryCache* cache = new TrajectoryCache();
+        if (cache->load(loadPath)) return new TrajectoryPlayer(cache);
+        SDL_Log("Failed to load %s: %s", loadPath, SDL_GetError());
+        delete cache;
+        return NULL;
+    }
+    if (!hasArg(argc, argv, "--cache-ahead")) return NULL;
+
+    // Keyframes go in every whole number of steps, other rates get the next one up
+    const Uint16 stepRate = 60;
+    float seconds = (float)SDL_atof(argValue(argc, argv, "--cache-ahead", "300"));
+    int rate = SDL_clamp(SDL_atoi(argValue(argc, argv, "--cache-rate", "30")), 1, stepRate);
+    Uint16 stepsPerFrame = (Uint16)(stepRate / rate);
+    if (stepRate % rate != 0) SDL_Log("--cache-rate %d doesn't divide the %d Hz step, using %d keyframes a second", rate, stepRate, stepRate / stepsPerFrame);
+    // Playback interpolates between two keyframes, fewer would never move
+    Uint32 frameCount = (Uint32)SDL_max(seconds * stepRate / stepsPerFrame, 0.0f);
+    if (frameCount < 2)
+    {
+        SDL_Log("--cache-ahead %g is under two keyframes, caching %.2f seconds", seconds, 2.0f * stepsPerFrame / stepRate);
+        frameCount = 2;
+    }
+    TrajectoryCache* cache = new TrajectoryCache();
+    cache->plan(frameCount, stepRate, stepsPerFrame, WINDOW_WIDTH / PIXELS_PER_METER, WINDOW_HEIGHT / PIXELS_PER_METER);
+
+    // The scenario the live overlay would run from the same seed
+    Simulation* sim = new Simulation(seed, createPhysics(argc, argv));
+    sim->attractors = createAttractors(argc, argv);
+    sim->spawner.rate = (float)SDL_atof(argValue(argc, argv, "--spawn-rate", "100"));
+    sim->spawn(SDL_atoi(argValue(argc, argv, "--burst", "0")), sim->screenSpawns());
+    recorder = new CacheRecorder(sim, cache, argValue(argc, argv, "--cache-save", NULL));
+    return new TrajectoryPlayer(cache);
+}
+
+// --windows [rate] turns the other windows on the desktop into obstacles,
+// polled that many times a second
+DesktopColliders* createDesktop(int argc, char* argv[], HWND overlay)
+{
+    if (!hasArg(argc, argv, "--windows")) return NULL;
+    float rate = SDL_max((float)SDL_atof(argValue(argc, argv, "--windows", "30")), 1.0f);
+    return new DesktopColliders(new Win32WindowProvider(overlay), 1.0f / rate, WINDOW_WIDTH, WINDOW_HEIGHT);
+}
+
+// --ghosts <count> bursts that many ghost particles out of every new circle,
+// --max-ghosts caps how many are alive at once
+GhostParticles* createGhosts(int argc, char* argv[], Uint64 seed)
+{
+    if (SDL_atoi(argValue(argc, argv, "--ghosts", "0")) <= 0) return NULL;
+    int capacity = SDL_atoi(argValue(argc, argv, "--max-ghosts", "200000"));
+    return new GhostParticles(capacity, WINDOW_WIDTH / PIXELS_PER_METER, WINDOW_HEIGHT / PIXELS_PER_METER, seed);
+}
+
+// Bursts out of the circles spawned in the last step, then moves them all
+void stepGhosts(const Simulation& sim, GhostParticles& ghosts, int perSpawn, float deltaTime)
+{
+    for (const SimEvent& event : sim.spawned)
+    {
+        ghosts.emit(perSpawn, event.x / PIXELS_PER_METER, event.y / PIXELS_PER_METER, 4.0f, 2.0f);
+    }
+    ghosts.step(deltaTime);
+}
+
+// Runs the spawn scenario without a window on a fixed step and mixes the audio
+// from the simulation clock into a WAV file instead of the sound device
+int renderAudio(int argc, char* argv[])
+{
+    const char* path = argValue(argc, argv, "--render-audio", "render.wav");
+    float seconds = (float)SDL_atof(argValue(argc, argv, "--seconds", "10"));
+    const float stepTime = 1.0f / 60;
+
+    SDL_setenv("SDL_AUDIODRIVER", "dummy", 1);
+    initAudio();
+    Mixer* mixer = new Mixer();
+    mixer->open(false);
+    Mix_Chunk** audios = hasArg(argc, argv, "--samples") ? loadAudios(NUM_AUDIOS, hasArg(argc, argv, "--external-audio")) : NULL;
+
+    int frequency, channels;
+    Mix_QuerySpec(&frequency, NULL, &channels);
+    int totalFrames = (int)(seconds * frequency);
+    Sint16* samples = new Sint16[(size_t)totalFrames * channels]();
+
+    Simulation sim(SDL_strtoull(argValue(argc, argv, "--seed", "1"), NULL, 10), createPhysics(argc, argv));
+    sim.attractors = createAttractors(argc, argv);
+    sim.cursor = createCursor(argc, argv);
+    sim.lod = createLod(argc, argv);
+    sim.continuous = createContinuous(argc, argv);
+
+    int framesMixed = 0;
+    Uint64 mixTicks = 0;
+    for (int step = 0; framesMixed < totalFrames; step++)
+    {
+        sim.step(stepTime);
+        playSpawnSounds(sim, mixer, audios, 0);
+
+        int stepEnd = SDL_min((int)((step + 1) * (double)stepTime * frequency), totalFrames);
+        Uint64 start = SDL_GetPerformanceCounter();
+        mixer->mix(samples + (size_t)framesMixed * channels, stepEnd - framesMixed);
+        mixTicks += SDL_GetPerformanceCounter() - start;
+        framesMixed = stepEnd;
+    }
+
+    double mixMs = mixTicks * 1000.0 / SDL_GetPerformanceFrequency();
+    SDL_Log("Mixed %.1f s of audio in %.2f ms, %.3f ms per second of audio", seconds, mixMs, mixMs / seconds);
+    bool written = writeWav(path, samples, totalFrames, channels, frequency);
+    if (!written) SDL_Log("Failed to write %s: %s", path, SDL_GetError());
+
+    delete[] samples;
+    delete mixer;
+    if (audios)
+    {
+        for (int i = 0; i < NUM_AUDIOS; ++i) Mix_FreeChunk(audios[i]);
+        delete[] audios;
+    }
+    Mix_CloseAudio();
+    SDL_Quit();
+    return written ? 0 : 1;
+}
+
+// Fills a headless world, then times saving it and restoring it into a fresh
+// one through a mapped snapshot
+int benchSnapshot(int argc, char* argv[])
+{
+    int count = SDL_atoi(argValue(argc, argv, "--bench-snapshot", "100000"));
+    const char* path = "bench.snapshot";
+    double frequency = (double)SDL_GetPerformanceFrequency();
+
+    Simulation* source = new Simulation(1, createPhysics(argc, argv));
+    source->spawn(count, source->screenSpawns());
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    std::vector<SnapshotBody> bodies;
+    source->takeSnapshot(bodies);
+    bool saved = saveSnapshot(path, bodies, WINDOW_WIDTH, WINDOW_HEIGHT);
+    double saveMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+    delete source;
+    if (!saved)
+    {
+        SDL_Log("Failed to save %s: %s", path, SDL_GetError());
+        return 1;
+    }
+
+    Simulation* target = new Simulation(1, createPhysics(argc, argv));
+    start = SDL_GetPerformanceCounter();
+    MappedSnapshot snapshot;
+    bool loaded = snapshot.open(path);
+    if (loaded) target->restore(snapshot.bodies, snapshot.header->bodyCount);
+    snapshot.close();
+    double loadMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+
+    SDL_Log("Snapshot of %d bodies: saved in %.2f ms, restored in %.2f ms", count, saveMs, loadMs);
+    delete target;
+    return loaded ? 0 : 1;
+}
+
+// Steps the same crowd of circles in both engines and compares step times
+int benchPhysics(int argc, char* argv[])
+{
+    int count = SDL_atoi(argValue(argc, argv, "--bench-physics", "1000"));
+    const int steps = 300;
+    const float stepTime = 1.0f / 60;
+    double frequency = (double)SDL_GetPerformanceFrequency();
+
+    PhysicsWorld* engines[] = { new Box2DWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT), new CircleWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT) };
+    const char* names[] = { "Box2D", "circles" };
+    for (int e = 0; e < 2; e++)
+    {
+        Simulation sim(1, engines[e]);
+        sim.spawn(count, sim.screenSpawns());
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (int i = 0; i < steps; i++) sim.physics->step(stepTime);
+        double stepMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency / steps;
+        SDL_Log("%s: %d circles, %.3f ms per step", names[e], count, stepMs);
+    }
+    return 0;
+}
+
+// Steps a crowd of each shape in Box2D, then one of all of them mixed, and
+// compares step times with the circles alone
+int benchShapes(int argc, char* argv[])
+{
+    int count = SDL_atoi(argValue(argc, argv, "--bench-shapes", "1000"));
+    const int steps = 300;
+    const float stepTime = 1.0f / 60;
+    double frequency = (double)SDL_GetPerformanceFrequency();
+
+    const char* names[] = { "circles", "boxes", "polygons", "capsules", "mixed" };
+    for (int s = 0; s <= SHAPE_TYPE_COUNT; s++)
+    {
+        Simulation sim(1, new Box2DWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT));
+        sim.shapes = s < SHAPE_TYPE_COUNT ? (Uint8)(1 << s) : (Uint8)((1 << SHAPE_TYPE_COUNT) - 1);
+        sim.spawn(count, sim.screenSpawns());
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (int i = 0; i < steps; i++) sim.physics->step(stepTime);
+        double stepMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency / steps;
+        SDL_Log("Box2D: %d %s, %.3f ms per step", count, names[s], stepMs);
+    }
+    return 0;
+}
+
+// Steps blobs and roped circles in Box2D with every soft body simulated,
+// then under the default budget, and reports the step times side by side
+int benchSoft(int argc, char* argv[])
+{
+    int blobs = SDL_atoi(argValue(argc, argv, "--bench-soft", "64"));
+    const int steps = 300;
+    const float stepTime = 1.0f / 60;
+    double frequency = (double)SDL_GetPerformanceFrequency();
+
+    const int budgets[] = { 1 << 30, SoftSettings().budget };
+    for (int budget : budgets)
+    {
+        SoftSettings settings;
+        settings.ropes = 4 * blobs;
+        settings.budget = budget;
+        Simulation sim(1, new Box2DWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT));
+        sim.spawner.rate = 0.0f;
+        sim.soft = new SoftBodies(settings);
+        sim.spawnBlobs(blobs);
+        sim.spawn(settings.ropes, sim.screenSpawns());
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (int i = 0; i < steps; i++) sim.step(stepTime);
+        double stepMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency / steps;
+        SDL_Log("Box2D: %d blobs and %d ropes, budget %d, %.3f ms per step", blobs, settings.ropes, SDL_min(budget, 5 * blobs), stepMs);
+        sim.soft->logStats();
+    }
+    return 0;
+}
+
+// Collects every debug draw layer over a settled crowd in both engines, 10k
+// bodies by default, and reports the cost per frame and what it would upload
+int benchDebugDraw(int argc, char* argv[])
+{
+    int count = SDL_atoi(argValue(argc, argv, "--bench-debugdraw", "10000"));
+    const int frames = 100;
+    double frequency = (double)SDL_GetPerformanceFrequency();
+
+    PhysicsWorld* engines[] = { new Box2DWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT), new CircleWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT) };
+    const char* names[] = { "Box2D", "circles" };
+    for (int e = 0; e < 2; e++)
+    {
+        Simulation sim(1, engines[e]);
+        sim.spawner.rate = 0.0f;
+        sim.spawn(count, sim.screenSpawns());
+        for (int i = 0; i < 60; i++) sim.step(1.0f / 60);
+
+        DebugBatch batch(PIXELS_PER_METER);
+        for (int layer = 0; layer <= DEBUG_DRAW_LAYERS; layer++)
+        {
+            batch.SetFlags(layer < DEBUG_DRAW_LAYERS ? DEBUG_DRAW_FLAGS[layer] : 0xFFFF);
+            Uint64 start = SDL_GetPerformanceCounter();
+            for (int f = 0; f < frames; f++)
+            {
+                batch.clear();
+                sim.physics->debugDraw(batch);
+            }
+            double frameMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency / frames;
+            size_t vertices = batch.triangles.size() + batch.lines.size();
+            SDL_Log("%s, %d bodies, %s: %.3f ms per frame, %zu triangle and %zu line vertices, %.2f MB to upload",
+                names[e], count, layer < DEBUG_DRAW_LAYERS ? DEBUG_DRAW_NAMES[layer] : "everything", frameMs,
+                batch.triangles.size(), batch.lines.size(), vertices * sizeof(DebugVertex) / 1048576.0);
+        }
+    }
+    return 0;
+}
+
+// Steps the circle engine with 1 up to --max-threads threads and reports the
+// step time, how busy each thread was and whether the end state matches the
+// single threaded run bit for bit
+int benchThreads(int argc, char* argv[])
+{
+    int count = SDL_atoi(argValue(argc, argv, "--bench-threads", "1000"));
+    int maxThreads = SDL_atoi(argValue(argc, argv, "--max-threads", "0"));
+    if (maxThreads <= 0) maxThreads = SDL_GetCPUCount();
+    const int steps = 300;
+    const float stepTime = 1.0f / 60;
+    double frequency = (double)SDL_GetPerformanceFrequency();
+
+    Uint64 serialHash = 0;
+    double serialMs = 0.0;
+    bool matches = true;
+    for (int threads = 1; threads <= maxThreads; threads++)
+    {
+        CircleWorld* world = new CircleWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT, threads);
+        Simulation sim(1, world);
+        sim.spawn(count, sim.screenSpawns());
+
+        world->pool.resetTimings();
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (int i = 0; i < steps; i++) world->step(stepTime);
+        double stepMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency / steps;
+
+        Uint64 hash = sim.stateHash();
+        if (threads == 1)
+        {
+            serialHash = hash;
+            serialMs = stepMs;
+        }
+        matches = matches && hash == serialHash;
+        SDL_Log("%d threads: %.3f ms per step, %.2fx, state %s", threads, stepMs, serialMs / stepMs, hash == serialHash ? "identical" : "DIFFERS");
+        for (int t = 0; t < threads; t++)
+        {
+            double busyMs = world->pool.busyTicks[t] * 1000.0 / frequency / steps;
+            SDL_Log("    thread %d: %.3f ms busy per step (%.0f%%)", t, busyMs, 100.0 * busyMs / stepMs);
+        }
+    }
+    return matches ? 0 : 1;
+}
+
+// Times the Barnes-Hut tree build and force pass for large crowds on one
+// thread and on --threads threads, and checks the forces against the exact
+// sum for a sample of bodies
+int benchAttractors(int argc, char* argv[])
+{
+    const int counts[] = { 10000, 30000, 100000 };
+    const int repeats = 10;
+    const int samples = 256;
+    int threads = SDL_atoi(argValue(argc, argv, "--threads", "0"));
+    if (threads <= 0) threads = SDL_GetCPUCount();
+    const float width = WINDOW_WIDTH / PIXELS_PER_METER, height = WINDOW_HEIGHT / PIXELS_PER_METER;
+    double frequency = (double)SDL_GetPerformanceFrequency();
+
+    AttractorSettings settings;
+    settings.mutualStrength = 1.0f;
+    settings.theta = (float)SDL_atof(argValue(argc, argv, "--theta", "0.5"));
+    for (int count : counts)
+    {
+        Rng rng(1);
+        std::vector<float> x(count), y(count), mass(count), forceX(count), forceY(count);
+        for (int i = 0; i < count; i++)
+        {
+            x[i] = rng.uniform() * width;
+            y[i] = rng.uniform() * height;
+            float r = rng.range(5, 25) / PIXELS_PER_METER;
+            mass[i] = CIRCLE_DENSITY * float(M_PI) * r * r;
+        }
+
+        // Exact sums for an evenly spread sample, compared as relative RMS error
+        std::vector<float> exactX(samples), exactY(samples);
+        for (int s = 0; s < samples; s++)
+        {
+            int i = s * (count / samples);
+            double fx = 0.0, fy = 0.0;
+            for (int j = 0; j < count; j++)
+            {
+                if (j == i) continue;
+                float dx = x[j] - x[i], dy = y[j] - y[i];
+                float inverse = 1.0f / SDL_sqrtf(dx * dx + dy * dy + settings.softening * settings.softening);
+                fx += mass[j] * inverse * inverse * inverse * dx;
+                fy += mass[j] * inverse * inverse * inverse * dy;
+            }
+            exactX[s] = (float)(mass[i] * fx);
+            exactY[s] = (float)(mass[i] * fy);
+        }
+
+        for (int threadCount : { 1, threads })
+        {
+            AttractorField field(settings, width, height, threadCount);
+            // computeForces builds the tree itself, the force pass is what's left
+            Uint64 buildTicks = 0, totalTicks = 0;
+            for (int r = 0; r < repeats; r++)
+            {
+                Uint64 start = SDL_GetPerformanceCounter();
+                field.tree.build(x.data(), y.data(), mass.data(), count, field.pool);
+                Uint64 built = SDL_GetPerformanceCounter();
+                field.computeForces(x.data(), y.data(), mass.data(), count, forceX.data(), forceY.data());
+                buildTicks += built - start;
+                totalTicks += SDL_GetPerformanceCounter() - built;
+            }
+
+            double errorSquared = 0.0, magnitudeSquared = 0.0;
+            for (int s = 0; s < samples; s++)
+            {
+                int i = s * (count / samples);
+                errorSquared += (forceX[i] - exactX[s]) * (forceX[i] - exactX[s]) + (forceY[i] - exactY[s]) * (forceY[i] - exactY[s]);
+                magnitudeSquared += exactX[s] * exactX[s] + exactY[s] * exactY[s];
+            }
+            double buildMs = buildTicks * 1000.0 / frequency / repeats;
+            double forceMs = totalTicks * 1000.0 / frequency / repeats - buildMs;
+            SDL_Log("%d bodies, %d threads: %d nodes, build %.3f ms, forces %.3f ms, %.3f%% RMS error",
+                count, threadCount, (int)field.tree.nodes.size(), buildMs, forceMs, 100.0 * SDL_sqrt(errorSquared / magnitudeSquared));
+        }
+    }
+    return 0;
+}
+
+// Steps a block of fluid particles as it falls and settles, next to the usual
+// crowd of circles, and reports the step time against a 60 Hz frame
+int benchFluid(int argc, char* argv[])
+{
+    int count = SDL_atoi(argValue(argc, argv, "--bench-fluid", "100000"));
+    int threads = SDL_atoi(argValue(argc, argv, "--threads", "0"));
+    if (threads <= 0) threads = SDL_GetCPUCount();
+    const int steps = 300;
+    const float stepTime = 1.0f / 60;
+    double frequency = (double)SDL_GetPerformanceFrequency();
+
+    Simulation sim(1, new CircleWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT));
+    sim.spawn(MAX_CIRCLES, sim.screenSpawns());
+    ParticleFluid fluid(FluidSettings(), WINDOW_WIDTH / PIXELS_PER_METER, WINDOW_HEIGHT / PIXELS_PER_METER, threads);
+    fluid.spawnBlock(count, 0.5f * WINDOW_WIDTH / PIXELS_PER_METER);
+
+    Uint64 totalTicks = 0, maxTicks = 0;
+    for (int i = 0; i < steps; i++)
+    {
+        sim.physics->step(stepTime);
+        Uint64 start = SDL_GetPerformanceCounter();
+        stepFluid(sim, fluid, stepTime);
+        Uint64 ticks = SDL_GetPerformanceCounter() - start;
+        totalTicks += ticks;
+        maxTicks = SDL_max(maxTicks, ticks);
+    }
+    double stepMs = totalTicks * 1000.0 / frequency / steps;
+    SDL_Log("%d particles, %d threads: %.3f ms per step on average, %.3f ms at most, %.0f%% of a 60 Hz frame, %.1f%% density error",
+        count, threads, stepMs, maxTicks * 1000.0 / frequency, stepMs * 6.0, 100.0 * fluid.densityError());
+    return 0;
+}
+
+// Keeps a screen full of ghost particles alive and reports what a step of
+// them costs. They never meet the physics world, so there is none here
+int benchGhosts(int argc, char* argv[])
+{
+    int count = SDL_atoi(argValue(argc, argv, "--bench-ghosts", "200000"));
+    const int steps = 300;
+    const float stepTime = 1.0f / 60;
+    double frequency = (double)SDL_GetPerformanceFrequency();
+
+    // Lifetimes far past the run, so the count holds
+    GhostParticles ghosts(count, WINDOW_WIDTH / PIXELS_PER_METER, WINDOW_HEIGHT / PIXELS_PER_METER, 1);
+    for (int i = 0; i < 100; i++)
+    {
+        float x = (i % 10 + 0.5f) * WINDOW_WIDTH / PIXELS_PER_METER / 10, y = (i / 10 + 0.5f) * WINDOW_HEIGHT / PIXELS_PER_METER / 10;
+        ghosts.emit(count / 100 + (i < count % 100), x, y, 4.0f, 1000.0f);
+    }
+
+    Uint64 totalTicks = 0, maxTicks = 0;
+    for (int i = 0; i < steps; i++)
+    {
+        Uint64 start = SDL_GetPerformanceCounter();
+        ghosts.step(stepTime);
+        Uint64 ticks = SDL_GetPerformanceCounter() - start;
+        totalTicks += ticks;
+        maxTicks = SDL_max(maxTicks, ticks);
+    }
+    double stepMs = totalTicks * 1000.0 / frequency / steps;
+    SDL_Log("%d ghost particles: %.3f ms per step on average, %.3f ms at most, %.2f ns per particle, %.0f%% of a 60 Hz frame",
+        ghosts.count, stepMs, maxTicks * 1000.0 / frequency, stepMs * 1e6 / SDL_max(ghosts.count, 1), stepMs * 6.0);
+    return 0;
+}
+
+// Sweeps the cursor over a settled crowd in both engines, pushing and setting
+// off an explosion now and then, and reports what the one query per step costs
+int benchCursor(int argc, char* argv[])
+{
+    const int counts[] = { 1000, 10000 };
+    const int steps = 300;
+    const float stepTime = 1.0f / 60;
+
+    for (int count : counts)
+    {
+        PhysicsWorld* engines[] = { new Box2DWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT), new CircleWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT) };
+        const char* names[] = { "Box2D", "circles" };
+        for (int e = 0; e < 2; e++)
+        {
+            Simulation sim(1, engines[e]);
+            sim.cursor = new CursorInteraction(CursorSettings());
+            sim.spawn(count, sim.screenSpawns());
+            for (int i = 0; i < 60; i++) sim.physics->step(stepTime);
+
+            // The cursor circles the middle of the screen
+            for (int i = 0; i < steps; i++)
+            {
+                float angle = 2.0f * float(M_PI) * i / steps;
+                float x = WINDOW_WIDTH * (0.5f + 0.3f * SDL_cosf(angle)), y = WINDOW_HEIGHT * (0.5f + 0.3f * SDL_sinf(angle));
+                sim.setCursor(x, y, i % 100 < 50 ? CURSOR_PUSH : CURSOR_GRAB, i % 100 == 99);
+                sim.cursor->apply(*sim.physics, stepTime);
+                sim.physics->step(stepTime);
+            }
+            SDL_Log("%s, %d circles:", names[e], count);
+            sim.cursor->logStats();
+        }
+    }
+    return 0;
+}
+
+// Runs the usual spawn scenario in both engines twice from the same seed, at
+// full rate and with LOD, and compares step times. Collisions are chaotic, so
+// comparing the two runs directly would mostly measure the chaos. Instead the
+// LOD run is set to the full rate state every two seconds, keeping its own
+// tiers, and the drift is measured half a second later
+int benchLod(int argc, char* argv[])
+{
+    const int steps = SDL_atoi(argValue(argc, argv, "--bench-lod", "1800"));
+    const int syncEvery = 120, measureAfter = 30;
+    const float stepTime = 1.0f / 60;
+    double frequency = (double)SDL_GetPerformanceFrequency();
+
+    const char* names[] = { "Box2D", "circles" };
+    for (int e = 0; e < 2; e++)
+    {
+        Simulation* runs[2];
+        Uint64 ticks[2] = {};
+        for (int r = 0; r < 2; r++)
+        {
+            PhysicsWorld* physics = e == 0 ? (PhysicsWorld*)new Box2DWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT)
+                                           : (PhysicsWorld*)new CircleWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT);
+            runs[r] = new Simulation(1, physics);
+        }
+        runs[1]->lod = createLod(argc, argv);
+        if (!runs[1]->lod) runs[1]->lod = new PhysicsLod(LodSettings());
+
+        SDL_Log("%s, reduced bodies trail by %.3f m at most:", names[e], runs[1]->lod->lagBound(stepTime));
+        double worstRms = 0.0, worstDrift = 0.0;
+        for (int i = 1; i <= steps; i++)
+        {
+            for (int r = 0; r < 2; r++)
+            {
+                Uint64 start = SDL_GetPerformanceCounter();
+                runs[r]->step(stepTime);
+                ticks[r] += SDL_GetPerformanceCounter() - start;
+            }
+            int count = (int)runs[0]->circles.size();
+            if (i % syncEvery == 0)
+            {
+                for (int b = 0; b < count; b++)
+                {
+                    BodyState state = runs[0]->physics->getState(b);
+                    state.awake = runs[1]->physics->getState(b).awake;
+                    runs[1]->physics->setState(b, state);
+                }
+            }
+            if (i % syncEvery != measureAfter || i < syncEvery) continue;
+
+            double errorSquared = 0.0, worst = 0.0;
+            for (int b = 0; b < count; b++)
+            {
+                b2Vec2 offset = runs[1]->physics->getPosition(b) - runs[0]->physics->getPosition(b);
+                errorSquared += offset.LengthSquared();
+                worst = SDL_max(worst, (double)offset.Length());
+            }
+            double rms = SDL_sqrt(errorSquared / count);
+            worstRms = SDL_max(worstRms, rms);
+            worstDrift = SDL_max(worstDrift, worst);
+            SDL_Log("    %5.1f s: %d circles, drift %.4f m RMS, %.4f m at most", i * stepTime, count, rms, worst);
+        }
+        double fullMs = ticks[0] * 1000.0 / frequency / steps, lodMs = ticks[1] * 1000.0 / frequency / steps;
+        SDL_Log("    full rate %.3f ms per step, LOD %.3f ms per step (%.2fx), drift %.4f m RMS and %.4f m at worst",
+            fullMs, lodMs, fullMs / lodMs, worstRms, worstDrift);
+        runs[1]->lod->logStats();
+        delete runs[0];
+        delete runs[1];
+    }
+    return 0;
+}
+
+// Drops bursts of circles with the usual spawn forces into Box2D with each
+// continuous collision mode and compares the time spent on time of impact
+// against how many circles tunneled out of the screen
+int benchContinuous(int argc, char* argv[])
+{
+    int count = SDL_atoi(argValue(argc, argv, "--bench-ccd", "5000"));
+    const int bursts = 10, burstEvery = 30, steps = bursts * burstEvery + 120;
+    const float stepTime = 1.0f / 60;
+    double frequency = (double)SDL_GetPerformanceFrequency();
+
+    const ContinuousMode modes[] = { CCD_ALWAYS, CCD_ADAPTIVE, CCD_OFF };
+    const char* names[] = { "always", "adaptive", "off" };
+    for (int m = 0; m < 3; m++)
+    {
+        Simulation sim(1, new Box2DWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT));
+        sim.continuous = new ContinuousPolicy(modes[m], (float)SDL_atof(argValue(argc, argv, "--ccd-fraction", "0.5")),
+            WINDOW_WIDTH / PIXELS_PER_METER, WINDOW_HEIGHT / PIXELS_PER_METER);
+        Uint64 ticks = 0;
+        for (int i = 0; i < steps; i++)
+        {
+            if (i % burstEvery == 0 && i < bursts * burstEvery)
+            {
+                sim.spawn(count / bursts, sim.screenSpawns());
+            }
+            int n = (int)sim.circles.size();
+            Uint64 start = SDL_GetPerformanceCounter();
+            sim.continuous->update(*sim.physics, n, stepTime);
+            sim.physics->step(stepTime);
+            ticks += SDL_GetPerformanceCounter() - start;
+            sim.continuous->checkEscapes(*sim.physics, n);
+        }
+        SDL_Log("%s: %d circles, %.3f ms per step", names[m], count, ticks * 1000.0 / frequency / steps);
+        sim.continuous->logStats(*sim.physics);
+    }
+    return 0;
+}
+
+// Plays a scripted desktop of windows being dragged, resized, opened and
+// closed against 1000 circles in both engines, and reports what each poll
+// costs next to the physics step
+int benchWindows(int argc, char* argv[])
+{
+    int count = SDL_atoi(argValue(argc, argv, "--bench-windows", "64"));
+    const int steps = 600;
+    const float stepTime = 1.0f / 60;
+    double frequency = (double)SDL_GetPerformanceFrequency();
+
+    const char* names[] = { "Box2D", "circles" };
+    for (int e = 0; e < 2; e++)
+    {
+        PhysicsWorld* physics = e == 0 ? (PhysicsWorld*)new Box2DWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT)
+                                       : (PhysicsWorld*)new CircleWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT);
+        Simulation sim(1, physics);
+        sim.spawn(1000, sim.screenSpawns());
+        DesktopColliders desktop(scriptedDesktop(count, steps, WINDOW_WIDTH, WINDOW_HEIGHT, 1), 0.0f, WINDOW_WIDTH, WINDOW_HEIGHT);
+        Uint64 stepTicks = 0;
+        for (int i = 0; i < steps; i++)
+        {
+            desktop.update(*sim.physics, stepTime);
+            Uint64 start = SDL_GetPerformanceCounter();
+            sim.physics->step(stepTime);
+            stepTicks += SDL_GetPerformanceCounter() - start;
+        }
+        SDL_Log("%s, %d windows: %.3f ms per physics step", names[e], count, stepTicks * 1000.0 / frequency / steps);
+        desktop.logStats();
+    }
+    return 0;
+}
+
+// Soaks a Box2D crowd for ten simulated minutes without and with tree
+// rebuilds and compares the step times of the last minute. --tree-log writes
+// both series to one CSV file
+int benchTree(int argc, char* argv[])
+{
+    int count = SDL_atoi(argValue(argc, argv, "--bench-tree", "2000"));
+    const int steps = 36000, tail = 3600;
+    const float stepTime = 1.0f / 60;
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    const char* logPath = argValue(argc, argv, "--tree-log", NULL);
+    SDL_RWops* log = logPath ? SDL_RWFromFile(logPath, "wb") : NULL;
+    if (log) TreeMonitor::writeCsvHeader(log);
+
+    const char* names[] = { "watch", "rebuild" };
+    for (int run = 0; run < 2; run++)
+    {
+        Simulation sim(1, new Box2DWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT));
+        sim.tree = new TreeMonitor(run == 0 ? 0.0f : (float)SDL_atof(argValue(argc, argv, "--tree-rebuild", "1.3")));
+        sim.cursor = new CursorInteraction(CursorSettings());
+        sim.spawner.rate = 0.0f;
+        sim.spawn(count, sim.screenSpawns());
+        Uint64 tailTicks = 0;
+        for (int i = 0; i < steps; i++)
+        {
+            // A cursor sweeping back and forth and going off every two
+            // seconds keeps the crowd moving, a settled one barely touches the tree
+            float sweep = (i % 600) / 600.0f;
+            sim.setCursor(WINDOW_WIDTH * (sweep < 0.5f ? 2.0f * sweep : 2.0f - 2.0f * sweep), 0.5f * WINDOW_HEIGHT, CURSOR_PUSH, i % 120 == 0);
+            Uint64 start = SDL_GetPerformanceCounter();
+            sim.step(stepTime);
+            sim.tree->idle(*sim.physics, 1000.0f / 60);
+            if (i >= steps - tail) tailTicks += SDL_GetPerformanceCounter() - start;
+        }
+        SDL_Log("%s: %d circles, %.3f ms per step over the last minute", names[run], count, tailTicks * 1000.0 / frequency / tail);
+        sim.tree->logStats();
+        if (log) sim.tree->writeCsv(log, names[run]);
+    }
+    if (log) SDL_RWclose(log);
+    return 0;
+}
+
+// Runs fixed steps back to back for a second of wall time at a few crowd
+// sizes in both engines. The simulated seconds per wall second are the
+// furthest fast forward could go with nothing left for drawing
+int benchTimeScale(int argc, char* argv[])
+{
+    const int counts[] = { 500, 1000, 2000, 5000 };
+    const float stepTime = 1.0f / 60;
+    double frequency = (double)SDL_GetPerformanceFrequency();
+
+    const char* names[] = { "Box2D", "circles" };
+    for (int count : counts)
+    {
+        for (int e = 0; e < 2; e++)
+        {
+            PhysicsWorld* physics = e == 0 ? (PhysicsWorld*)new Box2DWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT)
+                                           : (PhysicsWorld*)new CircleWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT);
+            Simulation sim(1, physics);
+            sim.spawner.rate = 0.0f;
+            sim.spawn(count, sim.screenSpawns());
+            for (int i = 0; i < 60; i++) sim.step(stepTime);
+
+            int steps = 0;
+            Uint64 start = SDL_GetPerformanceCounter(), elapsed = 0;
+            while (elapsed < (Uint64)frequency)
+            {
+                sim.step(stepTime);
+                steps++;
+                elapsed = SDL_GetPerformanceCounter() - start;
+            }
+            double wallSeconds = elapsed / frequency;
+            SDL_Log("%s, %d circles: %.2f simulated seconds per wall second, %.3f ms per step",
+                names[e], count, steps * stepTime / wallSeconds, wallSeconds * 1000.0 / steps);
+        }
+    }
+    return 0;
+}
+
+// Records 30 seconds of a crowd at a few sizes in both engines into a cache
+// at 30 keyframes a second, then compares what playing a frame back costs
+// with stepping it live
+int benchCache(int argc, char* argv[])
+{
+    const int counts[] = { 1000, 2000, 5000 };
+    const float seconds = 30.0f;
+    double frequency = (double)SDL_GetPerformanceFrequency();
+
+    const char* names[] = { "Box2D", "circles" };
+    for (int count : counts)
+    {
+        for (int e = 0; e < 2; e++)
+        {
+            PhysicsWorld* physics = e == 0 ? (PhysicsWorld*)new Box2DWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT)
+                                           : (PhysicsWorld*)new CircleWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT);
+            Simulation* sim = new Simulation(1, physics);
+            sim->spawner.rate = 0.0f;
+            sim->spawn(count, sim->screenSpawns());
+            TrajectoryCache cache;
+            cache.plan((Uint32)(seconds * 30), 60, 2, WINDOW_WIDTH / PIXELS_PER_METER, WINDOW_HEIGHT / PIXELS_PER_METER);
+
+            CacheRecorder* recorder = new CacheRecorder(sim, &cache, NULL);
+            while (!cache.complete) SDL_Delay(1);
+            double recordMs = recorder->ticks * 1000.0 / frequency;
+            delete recorder;
+
+            // Same crowd stepped live for comparison
+            Simulation live(1, e == 0 ? (PhysicsWorld*)new Box2DWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT)
+                                      : (PhysicsWorld*)new CircleWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT));
+            live.spawner.rate = 0.0f;
+            live.spawn(count, live.screenSpawns());
+            Uint64 start = SDL_GetPerformanceCounter();
+            for (int i = 0; i < 120; i++) live.step(1.0f / 60);
+            double liveMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency / 120;
+
+            // Positions go where a renderer would read them from
+            TrajectoryPlayer player(&cache);
+            std::vector<b2Vec2> positions(count);
+            start = SDL_GetPerformanceCounter();
+            for (int i = 0; i < 1200; i++)
+            {
+                player.advance(1.0f / 60);
+                for (int b = 0; b < player.count; b++) positions[b] = player.position(b);
+            }
+            double playMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency / 1200;
+
+            size_t bytes = cache.bytes();
+            SDL_Log("%s, %d circles: recorded %.0f s in %.0f ms, %.2f MB at %.1f bytes per circle and keyframe, %.4f ms per frame played back against %.3f ms stepped live",
+                names[e], count, seconds, recordMs, bytes / 1048576.0, (double)bytes / ((double)cache.frames.size() * count),
+                playMs, liveMs);
+        }
+    }
+    return 0;
+}
+
+// Times spawning bursts of 1k and 10k circles into a fresh world of each
+// engine, as one batch and one circle at a time
+int benchSpawn(int argc, char* argv[])
+{
+    const int counts[] = { 1000, 10000 };
+    double frequency = (double)SDL_GetPerformanceFrequency();
+
+    const char* names[] = { "Box2D", "circles" };
+    for (int count : counts)
+    {
+        for (int e = 0; e < 2; e++)
+        {
+            double ms[2];
+            for (int single = 0; single < 2; single++)
+            {
+                PhysicsWorld* physics = e == 0 ? (PhysicsWorld*)new Box2DWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT)
+                                               : (PhysicsWorld*)new CircleWorld((float)WINDOW_WIDTH, (float)WINDOW_HEIGHT);
+                Simulation sim(1, physics);
+                Uint64 start = SDL_GetPerformanceCounter();
+                if (single)
+                {
+                    for (int i = 0; i < count; i++) sim.spawn(1, sim.screenSpawns());
+                }
+                else sim.spawn(count, sim.screenSpawns());
+                ms[single] = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+            }
+            SDL_Log("%s, %d circles: batch %.3f ms (%.3f us per circle), one at a time %.3f ms",
+                names[e], count, ms[0], ms[0] * 1000.0 / count, ms[1]);
+        }
+    }
+    return 0;
+}
+
+// Counts the overlapping circles a dynamic tree query finds for one proxy
+struct TreePairCounter
+{
+    const b2DynamicTree* tree;
+    const std::vector<float>* x;
+    const std::vector<float>* y;
+    const std::vector<float>* radius;
+    int body;
+    int pairs;
+
+    bool QueryCallback(int32 proxy) {
+        int other = (int)(intptr_t)tree->GetUserData(proxy);
+        if (other == body) return true;
+        float dx = (*x)[other] - (*x)[body], dy = (*y)[other] - (*y)[body];
+        float reach = (*radius)[body] + (*radius)[other];
+        if (dx * dx + dy * dy < reach * reach) pairs++;
+        return true;
+    }
+};
+
+// Times finding overlapping pairs with the uniform grid against Box2D's
+// dynamic tree as the crowd grows. The tree does what b2BroadPhase does every
+// step, moving every proxy and querying the ones that left their fat AABB.
+// The grid rebuilds and finds every pair. Radii shrink with the count so the
+// screen stays about as covered as with the usual thousand circles
+int benchBroadphase(int argc, char* argv[])
+{
+    const int counts[] = { 1000, 10000, 100000 };
+    const int frames = 60;
+    const float stepTime = 1.0f / 60;
+    const float width = WINDOW_WIDTH / PIXELS_PER_METER, height = WINDOW_HEIGHT / PIXELS_PER_METER;
+    double frequency = (double)SDL_GetPerformanceFrequency();
+
+    for (int count : counts)
+    {
+        float scale = SDL_sqrtf(1000.0f / count);
+        Rng rng(1);
+        std::vector<float> x(count), y(count), radius(count), vx(count), vy(count);
+        for (int i = 0; i < count; i++)
+        {
+            radius[i] = rng.range(5, 25) * scale / PIXELS_PER_METER;
+            x[i] = radius[i] + rng.uniform() * (width - 2 * radius[i]);
+            y[i] = radius[i] + rng.uniform() * (height - 2 * radius[i]);
+            vx[i] = rng.uniform() * 4.0f - 2.0f;
+            vy[i] = rng.uniform() * 4.0f - 2.0f;
+        }
+        auto move = [&](int i) {
+            x[i] += vx[i] * stepTime;
+            y[i] += vy[i] * stepTime;
+            if (x[i] < radius[i] || x[i] > width - radius[i]) vx[i] = -vx[i];
+            if (y[i] < radius[i] || y[i] > height - radius[i]) vy[i] = -vy[i];
+        };
+
+        b2DynamicTree tree;
+        std::vector<int32> proxies(count);
+        for (int i = 0; i < count; i++)
+        {
+            b2AABB aabb;
+            aabb.lowerBound.Set(x[i] - radius[i], y[i] - radius[i]);
+            aabb.upperBound.Set(x[i] + radius[i], y[i] + radius[i]);
+            proxies[i] = tree.CreateProxy(aabb, (void*)(intptr_t)i);
+        }
+        std::vector<float> treeX = x, treeY = y, treeVx = vx, treeVy = vy;
+
+        TreePairCounter counter = { &tree, &x, &y, &radius, 0, 0 };
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (int frame = 0; frame < frames; frame++)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                b2Vec2 before(x[i], y[i]);
+                move(i);
+                b2AABB aabb;
+                aabb.lowerBound.Set(x[i] - radius[i], y[i] - radius[i]);
+                aabb.upperBound.Set(x[i] + radius[i], y[i] + radius[i]);
+                if (!tree.MoveProxy(proxies[i], aabb, b2Vec2(x[i], y[i]) - before)) continue;
+                counter.body = i;
+                tree.Query(&counter, tree.GetFatAABB(proxies[i]));
+            }
+        }
+        double treeMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency / frames;
+        int treePairs = counter.pairs;
+
+        // Same motion from the same starting state
+        x = treeX; y = treeY; vx = treeVx; vy = treeVy;
+        UniformGrid grid;
+        grid.configure(width, height, 25 * scale / PIXELS_PER_METER);
+        int gridPairs = 0;
+        start = SDL_GetPerformanceCounter();
+        for (int frame = 0; frame < frames; frame++)
+        {
+            for (int i = 0; i < count; i++) move(i);
+            grid.rebuild(x.data(), y.data(), radius.data(), count);
+            grid.findPairs([&gridPairs](int, int) { gridPairs++; });
+        }
+        double gridMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency / frames;
+
+        SDL_Log("%d circles: dynamic tree %.3f ms per step (%d new pairs), uniform grid %.3f ms per step (%d pairs)",
+            count, treeMs, treePairs / frames, gridMs, gridPairs / frames);
+    }
+    return 0;
+}
+
+// Replays a recorded log headless and as fast as possible, so a recorded
+// session doubles as a repeatable physics benchmark
+int replayLog(int argc, char* argv[])
+{
+    const char* path = argValue(argc, argv, "--replay", "session.bolg");
+    EventLog log;
+    if (!log.load(path))
+    {
+        SDL_Log("Failed to load %s: %s", path, SDL_GetError());
+        return 1;
+    }
+
+    // The world is set up from the recorded flags, logs from before they were
+    // recorded need the same ones passed again
+    std::vector<std::string> replayed, rest;
+    splitReplayedFlags(argc, argv, replayed, rest);
+    if (log.version >= 4) replayed = log.flags;
+    std::vector<char*> args(1, argv[0]);
+    for (std::vector<std::string>* list : { &rest, &replayed })
+    {
+        for (std::string& arg : *list) args.push_back(&arg[0]);
+    }
+    argc = (int)args.size();
+    argv = args.data();
+    std::string recorded;
+    for (const std::string& flag : replayed) recorded += " " + flag;
+    if (log.version >= 4) SDL_Log("Replaying with the recorded flags:%s", recorded.empty() ? " none" : recorded.c_str());
+
+    Simulation sim(log.seed, createPhysics(argc, argv));
+    sim.attractors = createAttractors(argc, argv);
+    sim.cursor = createCursor(argc, argv);
+    sim.lod = createLod(argc, argv);
+    sim.continuous = createContinuous(argc, argv);
+    sim.playback = &log;
+    const float stepTime = 1.0f / log.stepRate;
+
+    Uint64 totalTicks = 0, maxTicks = 0;
+    while (true)
+    {
+        Uint64 start = SDL_GetPerformanceCounter();
+        bool running = sim.step(stepTime);
+        Uint64 ticks = SDL_GetPerformanceCounter() - start;
+        if (!running) break;
+        totalTicks += ticks;
+        maxTicks = SDL_max(maxTicks, ticks);
+    }
+
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    SDL_Log("Replayed %u steps with %d circles, %.3f ms per step on average, %.3f ms at most",
+        sim.stepIndex, (int)sim.circles.size(), totalTicks * 1000.0 / frequency / SDL_max(sim.stepIndex, 1u), maxTicks * 1000.0 / frequency);
+
+    bool ended = !log.events.empty() && log.events.back().type == EVENT_END;
+    bool matches = ended && log.events.back().hash == sim.stateHash();
+    if (ended) SDL_Log(matches ? "Final state matches the recording" : "Final state differs from the recording");
+    return matches ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+    if (hasArg(argc, argv, "--render-audio")) return renderAudio(argc, argv);
+    if (hasArg(argc, argv, "--replay")) return replayLog(argc, argv);
+    if (hasArg(argc, argv, "--bench-snapshot")) return benchSnapshot(argc, argv);
+    if (hasArg(argc, argv, "--bench-physics")) return benchPhysics(argc, argv);
+    if (hasArg(argc, argv, "--bench-shapes")) return benchShapes(argc, argv);
+    if (hasArg(argc, argv, "--bench-soft")) return benchSoft(argc, argv);
+    if (hasArg(argc, argv, "--bench-debugdraw")) return benchDebugDraw(argc, argv);
+    if (hasArg(argc, argv, "--bench-broadphase")) return benchBroadphase(argc, argv);
+    if (hasArg(argc, argv, "--bench-threads")) return benchThreads(argc, argv);
+    if (hasArg(argc, argv, "--bench-attractors")) return benchAttractors(argc, argv);
+    if (hasArg(argc, argv, "--bench-fluid")) return benchFluid(argc, argv);
+    if (hasArg(argc, argv, "--bench-ghosts")) return benchGhosts(argc, argv);
+    if (hasArg(argc, argv, "--bench-cursor")) return benchCursor(argc, argv);
+    if (hasArg(argc, argv, "--bench-lod")) return benchLod(argc, argv);
+    if (hasArg(argc, argv, "--bench-ccd")) return benchContinuous(argc, argv);
+    if (hasArg(argc, argv, "--bench-spawn")) return benchSpawn(argc, argv);
+    if (hasArg(argc, argv, "--bench-windows")) return benchWindows(argc, argv);
+    if (hasArg(argc, argv, "--bench-tree")) return benchTree(argc, argv);
+    if (hasArg(argc, argv, "--bench-timescale")) return benchTimeScale(argc, argv);
+    if (hasArg(argc, argv, "--bench-cache")) return benchCache(argc, argv);
+
+    SDL_Window* window          = SDL_CreateWindow("OpenGL", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_BORDERLESS);
+    HWND        hwnd            = initTransparency(window);
+    HDC         hdc             = initOpenGL(hwnd);
+    Mixer*      mixer           = new Mixer();
+    initAudio();
+    mixer->open(true);
+
+    // Impacts are synthesized unless the plop samples are asked for
+    Mix_Chunk** audios = hasArg(argc, argv, "--samples") ? loadAudios(NUM_AUDIOS, hasArg(argc, argv, "--external-audio")) : NULL;
+
+    // Sounds are panned across the whole virtual desktop, not just our window
+    int windowX, windowY;
+    SDL_GetWindowPosition(window, &windowX, &windowY);
+
+    Uint64 seed = SDL_strtoull(argValue(argc, argv, "--seed", "1"), NULL, 10);
+    Simulation* sim = new Simulation(seed, createPhysics(argc, argv));
+    sim->attractors = createAttractors(argc, argv);
+    sim->cursor = createCursor(argc, argv);
+    sim->lod = createLod(argc, argv);
+    sim->continuous = createContinuous(argc, argv);
+    sim->spawner.rate = (float)SDL_atof(argValue(argc, argv, "--spawn-rate", "100"));
+    sim->shapes = createShapes(argc, argv);
+    ParticleFluid* fluid = createFluid(argc, argv);
+    GhostParticles* ghosts = createGhosts(argc, argv, seed);
+    int ghostsPerSpawn = SDL_atoi(argValue(argc, argv, "--ghosts", "0"));
+    PointRenderer* pointRenderer = fluid || ghosts ? new PointRenderer() : NULL;
+    ShapeRenderer* shapeRenderer = new ShapeRenderer();
+    DebugRenderer* debugRenderer = new DebugRenderer();
+    debugRenderer->batch.SetFlags(debugDrawFlags(argc, argv));
+
+    // Recording implies the fixed step, wall clock steps can't be replayed
+    const char* recordPath = argValue(argc, argv, "--record", NULL);
+    bool deterministic = recordPath || hasArg(argc, argv, "--deterministic");
+    EventLog recording;
+    recording.seed = seed;
+    std::vector<std::string> notReplayed;
+    splitReplayedFlags(argc, argv, recording.flags, notReplayed);
+    if (recordPath) sim->recording = &recording;
+    const float fixedStep = 1.0f / recording.stepRate;
+    // Only decides how many steps run per frame, so it works while recording too
+    TimeScale timeScale((float)SDL_atof(argValue(argc, argv, "--time-scale", "1")));
+
+    // --physics-budget trades solver quality for step time, which a replay
+    // couldn't reproduce, so deterministic runs keep the fixed quality
+    SolverGovernor* governor = NULL;
+    if (hasArg(argc, argv, "--physics-budget"))
+    {
+        if (deterministic) SDL_Log("--physics-budget is ignored in deterministic mode");
+        else
+        {
+            governor = new SolverGovernor((float)SDL_atof(argValue(argc, argv, "--physics-budget", "4")),
+                SDL_atoi(argValue(argc, argv, "--min-quality", "0")),
+                SDL_atoi(argValue(argc, argv, "--max-quality", "7"))); // The top level, higher ones are clamped to it
+            sim->governor = governor;
+        }
+    }
+
+    // Windows come and go outside the event log, a replay couldn't bring them back either
+    DesktopColliders* desktop = NULL;
+    if (hasArg(argc, argv, "--windows"))
+    {
+        if (deterministic) SDL_Log("--windows is ignored in deterministic mode");
+        else desktop = createDesktop(argc, argv, hwnd);
+    }
+    sim->tree = createTreeMonitor(argc, argv, deterministic);
+    sim->soft = createSoft(argc, argv, deterministic);
+
+    // A cache plays back on its own, the live simulation sits idle meanwhile
+    CacheRecorder* recorder = NULL;
+    TrajectoryPlayer* player = NULL;
+    if (hasArg(argc, argv, "--cache-ahead") || hasArg(argc, argv, "--cache-load"))
+    {
+        if (deterministic) SDL_Log("--cache-ahead and --cache-load are ignored in deterministic mode");
+        else player = createPlayback(argc, argv, seed, recorder);
+    }
+    std::vector<CachedBody> playbackBodies;
+
+    // Pick up the scene where the last run left it. A recording has to start
+    // from an empty world to replay, so it never resumes
+    char* prefPath = SDL_GetPrefPath("BouncyOverlay", "BouncyOverlay");
+    char defaultSnapshotPath[1024];
+    SDL_snprintf(defaultSnapshotPath, sizeof(defaultSnapshotPath), "%sworld.snapshot", prefPath ? prefPath : "");
+    SDL_free(prefPath);
+    const char* snapshotPath = hasArg(argc, argv, "--no-snapshot") || player ? NULL : argValue(argc, argv, "--snapshot", defaultSnapshotPath);
+    if (snapshotPath && !recordPath)
+    {
+        MappedSnapshot snapshot;
+        if (snapshot.open(snapshotPath)) sim->restore(snapshot.bodies, snapshot.header->bodyCount);
+        snapshot.close();
+    }
+
+    // --burst drops that many circles at once on top of whatever is there,
+    // --decor that many small ones that only bounce off the others. A cache
+    // being played back had its burst in the recorder's simulation
+    if (!player)
+    {
+        sim->spawn(SDL_atoi(argValue(argc, argv, "--burst", "0")), sim->screenSpawns());
+        SpawnDistribution decor = sim->screenSpawns();
+        decor.minRadius = 2;
+        decor.maxRadius = 6;
+        decor.category = CATEGORY_DECOR;
+        sim->spawn(SDL_atoi(argValue(argc, argv, "--decor", "0")), decor);
+        if (sim->soft) sim->spawnBlobs(sim->soft->settings.blobs);
+    }
+
+    SDL_Event windowEvent;
+    Uint32 prevTicks = SDL_GetTicks();
+    bool running = true;
+    bool explodeWasDown = false;
+    bool fasterWasDown = false, slowerWasDown = false;
+    bool debugWasDown[DEBUG_DRAW_LAYERS] = {};
+
+    while (running)
+    {
+        Uint64 frameStart = SDL_GetPerformanceCounter();
+        Uint32 currentTicks = SDL_GetTicks();
+        float deltaTime = (currentTicks - prevTicks) / 1000.0f; // deltaTime in seconds
+        prevTicks = currentTicks;
+
+        while (SDL_PollEvent(&windowEvent))
+        {
+            if (windowEvent.type == SDL_QUIT) running = false;
+            if (windowEvent.type == SDL_KEYDOWN) sim->recordKey(windowEvent.key.keysym.sym);
+        }
+        updateCursor(*sim, windowX, windowY, explodeWasDown);
+        if (desktop) desktop->update(*sim->physics, deltaTime);
+        updateTimeScale(timeScale, fasterWasDown, slowerWasDown);
+        updateDebugDraw(debugRenderer->batch, debugWasDown);
+
+        // Deterministic runs catch up in whole steps, the others split the
+        // frame's scaled time into steps no longer than a 60 Hz one.
+        // Fast forward draws only what the last step left
+        float stepTime = fixedStep;
+        int steps = 0;
+        if (deterministic) steps = timeScale.fixedSteps(deltaTime, fixedStep);
+        else steps = timeScale.variableSteps(deltaTime, 1.0f / 60, stepTime);
+        if (player)
+        {
+            player->advance(deltaTime * timeScale.scale);
+            steps = 0;
+        }
+        for (int i = 0; i < steps; i++) {
+            sim->step(stepTime);
+            if (fluid) stepFluid(*sim, *fluid, stepTime);
+            if (ghosts) stepGhosts(*sim, *ghosts, ghostsPerSpawn, stepTime);
+            playSpawnSounds(*sim, mixer, audios, windowX);
+        }
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glUseProgram(shaderProgram);
-        glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, glm::value_ptr(orthoMatrix));
-        for (size_t i = 0; i < circles_position; i++)
+        if (pointRenderer)
         {
-            circles[i]->update();
-            circles[i]->render();
+            // Fluid points as wide as the smoothing radius overlap into one surface
+            if (fluid) pointRenderer->render(fluid->x.data(), fluid->y.data(), fluid->count, fluid->smoothing * PIXELS_PER_METER, glm::vec4(0.2f, 0.5f, 1.0f, 1.0f));
+            if (ghosts) pointRenderer->render(ghosts->x.data(), ghosts->y.data(), ghosts->count, 3.0f, glm::vec4(1.0f, 1.0f, 1.0f, 0.6f));
         }
+        if (player)
+        {
+            while ((int)playbackBodies.size() < player->count) playbackBodies.push_back(player->cache->body((int)playbackBodies.size()));
+            for (int i = 0; i < player->count; i++)
+            {
+                const CachedBody& body = playbackBodies[i];
+                shapeRenderer->add(SHAPE_CIRCLE, 0, player->position(i), 0.0f, body.radius / PIXELS_PER_METER, glm::vec3(body.red, body.green, body.blue) / 255.0f);
+            }
+        }
+        else
+        {
+            shapeRenderer->reserve(sim->circles.capacity());
+            for (Circle* circle : sim->circles) circle->draw(*shapeRenderer);
+            if (sim->soft) drawRopes(*sim, *shapeRenderer);
+        }
+        shapeRenderer->render();
+        debugRenderer->render(*sim->physics);
         glFlush();
+        // Whatever is left of a 60 Hz frame can go to a tree rebuild
+        if (sim->tree)
+        {
+            double usedMs = (SDL_GetPerformanceCounter() - frameStart) * 1000.0 / SDL_GetPerformanceFrequency();
+            sim->tree->idle(*sim->physics, (float)(1000.0 / 60 - usedMs));
+        }
         SwapBuffers(hdc);
     }
-    for (size_t i = 0; i < circles_position; i++) delete circles[i];
-    delete[] &circles;
-    for (int i = 0; i < NUM_AUDIOS; ++i) Mix_FreeChunk(audios[i]);
+    if (recordPath)
+    {
+        sim->endRecording();
+        if (!recording.save(recordPath)) SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Failed to save recording", recordPath, NULL);
+    }
+    if (snapshotPath)
+    {
+        std::vector<SnapshotBody> bodies;
+        sim->takeSnapshot(bodies);
+        saveSnapshot(snapshotPath, bodies, WINDOW_WIDTH, WINDOW_HEIGHT);
+    }
+    timeScale.logStats();
+    shapeRenderer->logStats();
+    debugRenderer->logStats();
+    // The recorder goes first, its thread may still be writing to the cache
+    delete recorder;
+    if (player)
+    {
+        player->logStats();
+        delete player->cache;
+        delete player;
+    }
+    if (sim->cursor) sim->cursor->logStats();
+    if (sim->lod) sim->lod->logStats();
+    if (sim->continuous) sim->continuous->logStats(*sim->physics);
+    if (sim->soft) sim->soft->logStats();
+    if (sim->tree)
+    {
+        sim->tree->logStats();
+        const char* treeLogPath = argValue(argc, argv, "--tree-log", NULL);
+        if (treeLogPath && !sim->tree->save(treeLogPath, "live")) SDL_Log("Failed to save %s", treeLogPath);
+    }
+    if (governor)
+    {
+        governor->logStats();
+        delete governor;
+    }
+    if (desktop)
+    {
+        desktop->logStats();
+        delete desktop;
+    }
+    delete pointRenderer;
+    delete shapeRenderer;
+    delete debugRenderer;
+    delete fluid;
+    delete ghosts;
+    delete sim;
+    mixer->close();
+    delete mixer;
+    if (audios)
+    {
+        for (int i = 0; i < NUM_AUDIOS; ++i) Mix_FreeChunk(audios[i]);
+        delete[] audios;
+    }
     Mix_CloseAudio();
     wglMakeCurrent(NULL, NULL);
     wglDeleteContext(wglGetCurrentContext());
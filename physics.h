@@ -0,0 +1,440 @@
+#pragma once
+
+#include "shapes.h"
+#include <SDL2/SDL_stdinc.h>
+#include <box2d/box2d.h>
+#include <algorithm>
+#include <vector>
+
+const float PIXELS_PER_METER = 48.0f;
+
+// Circles are created with the same material whatever engine simulates them
+const float CIRCLE_DENSITY = 1.0f;
+const float CIRCLE_FRICTION = 1.0f;
+const float CIRCLE_RESTITUTION = 0.75f;
+const float WALL_FRICTION = 0.2f; // b2FixtureDef's default, which the walls always used
+
+// Collision categories, a body collides with the categories in its mask and
+// only when theirs holds its own. Walls keep b2Filter's default category
+const Uint16 CATEGORY_WALL = 0x0001;
+const Uint16 CATEGORY_CIRCLE = 0x0002;
+const Uint16 CATEGORY_DECOR = 0x0004; // Decorative circles, they pass through each other
+
+inline Uint16 collisionMask(Uint16 category)
+{
+    switch (category) {
+    case CATEGORY_CIRCLE: return CATEGORY_WALL | CATEGORY_CIRCLE | CATEGORY_DECOR;
+    case CATEGORY_DECOR: return CATEGORY_WALL | CATEGORY_CIRCLE;
+    default: return 0xFFFF;
+    }
+}
+
+// Level of detail a body is simulated at, see lod.h
+enum LodTier
+{
+    LOD_FULL = 0,
+    LOD_REDUCED = 1, // Stepped once every LOD_REDUCED_INTERVAL steps
+    LOD_FROZEN = 2,  // Asleep until something runs into it
+};
+const int LOD_TIER_COUNT = 3;
+const int LOD_REDUCED_INTERVAL = 4;
+const float LOD_WAKE_SPEED = 0.5f; // Approach speed that pulls a body out of a lower tier
+const float OBSTACLE_WAKE_MARGIN = 0.1f; // Bodies this close to an obstacle that changes are woken
+const float CONTACT_POINT_SIZE = 4.0f; // Pixels, for debug drawing
+
+// Shape of a broadphase tree, all zero for engines without one
+struct BroadphaseStats
+{
+    int height;    // Longest path from the root to a leaf
+    int balance;   // Largest height difference between two siblings
+    float quality; // Area of all nodes over the area of the root, lower is better
+    int proxies;
+};
+
+struct BodyState
+{
+    b2Vec2 position;
+    float angle;
+    b2Vec2 velocity;
+    float angularVelocity;
+    bool awake;
+};
+
+// What the simulation needs from a physics engine: circles bouncing around
+// inside the screen rectangle, addressed by the index createCircle returned.
+// Everything is in world units
+struct PhysicsWorld
+{
+    // Solver quality, may change between steps
+    int velocityIterations = 6;
+    int positionIterations = 2;
+    int subSteps = 1;
+
+    // Continuous collision work so far, engines without it leave them at zero
+    Uint64 toiUpdates = 0;
+    double toiMs = 0.0;
+
+    virtual ~PhysicsWorld() {}
+    // Makes room for this many bodies in total before a batch is created
+    virtual void reserve(int bodies) = 0;
+    virtual int createCircle(b2Vec2 position, float radius, Uint16 category) = 0;
+    // Engines that only simulate circles get one as large as the shape
+    virtual int createShape(b2Vec2 position, const BodyShape& shape, Uint16 category) {
+        return createCircle(position, boundingRadius(shape), category);
+    }
+    virtual void applyForce(int body, b2Vec2 force) = 0;
+    virtual void applyImpulse(int body, b2Vec2 impulse) = 0;
+    virtual b2Vec2 getPosition(int body) const = 0;
+    virtual float getAngle(int body) const = 0;
+    virtual float getMass(int body) const = 0;
+    // Bounding radius for shapes other than circles
+    virtual float getRadius(int body) const = 0;
+    virtual BodyState getState(int body) const = 0;
+    virtual void setState(int body, const BodyState& state) = 0;
+    virtual void step(float deltaTime) = 0;
+    // Appends every circle whose bounding box overlaps box, callers check the exact distance
+    virtual void queryAABB(const b2AABB& box, std::vector<int>& bodies) = 0;
+    virtual void setLod(int body, LodTier tier) = 0;
+    // Continuous collision against the walls for everything, and bullets also against other circles
+    virtual void setContinuousPhysics(bool enabled) = 0;
+    virtual void setBullet(int body, bool bullet) = 0;
+    // A soft distance joint holding two bodies at the distance they are now,
+    // the pair no longer collides. Returns -1 on engines without joints
+    virtual int createSpring(int /*a*/, int /*b*/, float /*hertz*/, float /*dampingRatio*/) {
+        return -1;
+    }
+    // Static boxes on top of the walls, addressed by the handle createObstacle
+    // returned until they are destroyed. Handles of destroyed ones are reused.
+    // Bodies resting against an obstacle wake up when it moves or goes away
+    virtual int createObstacle(const b2AABB& box) = 0;
+    virtual void moveObstacle(int obstacle, const b2AABB& box) = 0;
+    virtual void destroyObstacle(int obstacle) = 0;
+    virtual BroadphaseStats getBroadphaseStats() const = 0;
+    // Rebuilds the broadphase from scratch. Costs about a step and drops the
+    // contacts, so the next step starts them without warm starting
+    virtual void rebuildBroadphase() = 0;
+    // Reports what the flags of draw ask for: e_shapeBit, e_jointBit,
+    // e_aabbBit and e_centerOfMassBit as b2World::DebugDraw has them, and
+    // the points of touching contacts for e_pairBit, which it leaves unused
+    virtual void debugDraw(b2Draw& draw) = 0;
+};
+
+// Interleaves the bits of two 16 bit coordinates, sorting by the result walks
+// the plane along a Z order curve
+inline Uint32 mortonKey(Uint32 x, Uint32 y)
+{
+    Uint32 key = 0;
+    for (int bit = 0; bit < 16; bit++) key |= ((x >> bit) & 1u) << (2 * bit) | ((y >> bit) & 1u) << (2 * bit + 1);
+    return key;
+}
+
+// Takes a free slot or makes a new one
+inline int claimSlot(std::vector<int>& freeSlots, int& slotCount)
+{
+    if (freeSlots.empty()) return slotCount++;
+    int slot = freeSlots.back();
+    freeSlots.pop_back();
+    return slot;
+}
+
+inline b2AABB widened(const b2AABB& box, float margin)
+{
+    b2AABB result;
+    result.lowerBound.Set(box.lowerBound.x - margin, box.lowerBound.y - margin);
+    result.upperBound.Set(box.upperBound.x + margin, box.upperBound.y + margin);
+    return result;
+}
+
+// The fixture of a static box, the screen walls and the obstacles share it
+inline b2Fixture* createWallFixture(b2Body* body, float halfWidth, float halfHeight)
+{
+    b2PolygonShape groundBox;
+    groundBox.SetAsBox(halfWidth, halfHeight);
+
+    b2FixtureDef fixtureDef;
+    fixtureDef.shape = &groundBox;
+    fixtureDef.filter.categoryBits = CATEGORY_WALL;
+    fixtureDef.filter.maskBits = collisionMask(CATEGORY_WALL);
+    return body->CreateFixture(&fixtureDef);
+}
+
+struct Wall
+{
+    b2Body* body;
+    Wall(b2Vec2 pos, b2Vec2 size, b2World& world) {
+        b2BodyDef groundBodyDef;
+        groundBodyDef.position.Set(pos.x / PIXELS_PER_METER, pos.y / PIXELS_PER_METER);
+        body = world.CreateBody(&groundBodyDef);
+        createWallFixture(body, 0.5f * size.x / PIXELS_PER_METER, 0.5f * size.y / PIXELS_PER_METER);
+    }
+};
+
+// Collects the bodies behind the fixtures a world query reports. Capsules
+// are the only bodies with more than one fixture, they are checked against
+// the ones already reported so none comes up twice
+struct BodyCollector : b2QueryCallback
+{
+    std::vector<int>* bodies;
+    std::vector<int> compound;
+
+    bool ReportFixture(b2Fixture* fixture) override {
+        b2Body* body = fixture->GetBody();
+        if (body->GetType() != b2_dynamicBody) return true;
+        int index = (int)body->GetUserData().pointer;
+        if (body->GetFixtureList()->GetNext()) {
+            if (std::find(compound.begin(), compound.end(), index) != compound.end()) return true;
+            compound.push_back(index);
+        }
+        bodies->push_back(index);
+        return true;
+    }
+};
+
+// The fixture every body gets, whatever its shape
+inline b2FixtureDef bodyFixture(const b2Shape* shape, Uint16 category)
+{
+    b2FixtureDef fixtureDef;
+    fixtureDef.shape = shape;
+    fixtureDef.density = CIRCLE_DENSITY;
+    fixtureDef.friction = CIRCLE_FRICTION;
+    fixtureDef.restitution = CIRCLE_RESTITUTION;
+    fixtureDef.filter.categoryBits = category;
+    fixtureDef.filter.maskBits = collisionMask(category);
+    return fixtureDef;
+}
+
+// Counts contacts Box2D updates while solving time of impact events. Step
+// runs Collide, which updates contacts, then Solve, which reports solved
+// contacts, then SolveTOI. So a contact updated after the first report of a
+// step belongs to a TOI event. Steps without any regular contact miss the
+// updates before their first TOI island reports
+struct ToiCounter : b2ContactListener
+{
+    bool solved = false;
+    Uint64 updates = 0;
+
+    void PreSolve(b2Contact*, const b2Manifold*) override {
+        if (solved) updates++;
+    }
+    void PostSolve(b2Contact*, const b2ContactImpulse*) override {
+        solved = true;
+    }
+};
+
+// The general purpose engine, walls are 10 pixel thick boxes just outside the screen
+struct Box2DWorld : PhysicsWorld
+{
+    b2World world;
+    std::vector<b2Body*> bodies;
+    std::vector<float> radii; // Bounding radius of each body
+    std::vector<b2Vec2> outline;
+    std::vector<b2Joint*> joints;
+    std::vector<b2Body*> obstacles; // NULL for free handles
+    std::vector<b2AABB> obstacleBoxes;
+    std::vector<int> freeObstacles;
+    std::vector<int> found;
+    std::vector<Uint64> rebuildOrder;
+    ToiCounter toiCounter;
+
+    Box2DWorld(float width, float height) : world(b2Vec2(0.0f, 0.0f)) {
+        world.SetAutoClearForces(false);
+        world.SetContactListener(&toiCounter);
+        Wall(b2Vec2(width / 2, height + 5), b2Vec2(width, 10), world);
+        Wall(b2Vec2(width / 2, -5), b2Vec2(width, 10), world);
+        Wall(b2Vec2(-5, height / 2), b2Vec2(10, height), world);
+        Wall(b2Vec2(width + 5, height / 2), b2Vec2(10, height), world);
+    }
+
+    // Bodies come from Box2D's block allocator, only the index needs room
+    void reserve(int count) override {
+        bodies.reserve(count);
+        radii.reserve(count);
+    }
+    int createCircle(b2Vec2 position, float radius, Uint16 category) override {
+        b2CircleShape circle;
+        circle.m_radius = radius;
+
+        b2FixtureDef fixtureDef = bodyFixture(&circle, category);
+        addBody(position, radius)->CreateFixture(&fixtureDef);
+        return (int)bodies.size() - 1;
+    }
+    // Boxes and polygons are a single b2PolygonShape. Box2D has no capsule
+    // before 3.0, so one is a box with a circle on either end
+    int createShape(b2Vec2 position, const BodyShape& shape, Uint16 category) override {
+        if (shape.type == SHAPE_CIRCLE) return createCircle(position, shape.radius, category);
+        b2Body* body = addBody(position, boundingRadius(shape));
+        float r = shape.radius;
+        b2PolygonShape polygon;
+        if (shape.type == SHAPE_CAPSULE) polygon.SetAsBox(0.5f * r, 0.5f * r);
+        else {
+            unitOutline(shape.type, shape.sides, outline);
+            for (b2Vec2& point : outline) point *= r;
+            polygon.Set(outline.data(), (int32)outline.size());
+        }
+        b2FixtureDef fixtureDef = bodyFixture(&polygon, category);
+        body->CreateFixture(&fixtureDef);
+        if (shape.type == SHAPE_CAPSULE) {
+            b2CircleShape cap;
+            cap.m_radius = 0.5f * r;
+            fixtureDef = bodyFixture(&cap, category);
+            for (float side : { -0.5f, 0.5f }) {
+                cap.m_p.Set(side * r, 0.0f);
+                body->CreateFixture(&fixtureDef);
+            }
+        }
+        return (int)bodies.size() - 1;
+    }
+    int createSpring(int a, int b, float hertz, float dampingRatio) override {
+        b2DistanceJointDef jointDef;
+        jointDef.Initialize(bodies[a], bodies[b], bodies[a]->GetPosition(), bodies[b]->GetPosition());
+        b2LinearStiffness(jointDef.stiffness, jointDef.damping, hertz, dampingRatio, bodies[a], bodies[b]);
+        joints.push_back(world.CreateJoint(&jointDef));
+        return (int)joints.size() - 1;
+    }
+    b2Body* addBody(b2Vec2 position, float radius) {
+        b2BodyDef bodyDef;
+        bodyDef.type = b2_dynamicBody;
+        bodyDef.position = position;
+        bodyDef.userData.pointer = bodies.size();
+        bodies.push_back(world.CreateBody(&bodyDef));
+        radii.push_back(radius);
+        return bodies.back();
+    }
+    void applyForce(int body, b2Vec2 force) override {
+        bodies[body]->ApplyForce(force, bodies[body]->GetPosition(), true);
+    }
+    void applyImpulse(int body, b2Vec2 impulse) override {
+        bodies[body]->ApplyLinearImpulseToCenter(impulse, true);
+    }
+    b2Vec2 getPosition(int body) const override {
+        return bodies[body]->GetPosition();
+    }
+    float getAngle(int body) const override {
+        return bodies[body]->GetAngle();
+    }
+    float getMass(int body) const override {
+        return bodies[body]->GetMass();
+    }
+    float getRadius(int body) const override {
+        return radii[body];
+    }
+    BodyState getState(int body) const override {
+        const b2Body* b = bodies[body];
+        return { b->GetPosition(), b->GetAngle(), b->GetLinearVelocity(), b->GetAngularVelocity(), b->IsAwake() };
+    }
+    void setState(int body, const BodyState& state) override {
+        b2Body* b = bodies[body];
+        b->SetTransform(state.position, state.angle);
+        b->SetLinearVelocity(state.velocity);
+        b->SetAngularVelocity(state.angularVelocity);
+        b->SetAwake(state.awake);
+    }
+    // Forces are cleared by hand so they act on every sub-step
+    void step(float deltaTime) override {
+        for (int i = 0; i < subSteps; i++) {
+            toiCounter.solved = false;
+            world.Step(deltaTime / subSteps, velocityIterations, positionIterations);
+            toiMs += world.GetProfile().solveTOI;
+        }
+        toiUpdates = toiCounter.updates;
+        world.ClearForces();
+    }
+    void queryAABB(const b2AABB& box, std::vector<int>& found) override {
+        BodyCollector collector;
+        collector.bodies = &found;
+        world.QueryAABB(&collector, box);
+    }
+    // Box2D steps every awake body at the same rate, so only freezing does
+    // anything. Its islands wake frozen bodies as soon as they are touched
+    void setLod(int body, LodTier tier) override {
+        if (tier == LOD_FROZEN) bodies[body]->SetAwake(false);
+    }
+    void setContinuousPhysics(bool enabled) override {
+        world.SetContinuousPhysics(enabled);
+    }
+    void setBullet(int body, bool bullet) override {
+        bodies[body]->SetBullet(bullet);
+    }
+
+    // Each obstacle is a static body of its own, so changing one only moves
+    // its proxy in the broadphase tree. A resize swaps the fixture, a plain
+    // move keeps it
+    int createObstacle(const b2AABB& box) override {
+        int slotCount = (int)obstacles.size();
+        int obstacle = claimSlot(freeObstacles, slotCount);
+        obstacles.resize(slotCount, NULL);
+        obstacleBoxes.resize(slotCount);
+        obstacleBoxes[obstacle] = box;
+
+        b2BodyDef bodyDef;
+        bodyDef.position = box.GetCenter();
+        obstacles[obstacle] = world.CreateBody(&bodyDef);
+        b2Vec2 half = box.GetExtents();
+        createWallFixture(obstacles[obstacle], half.x, half.y);
+        wakeAround(box);
+        return obstacle;
+    }
+    void moveObstacle(int obstacle, const b2AABB& box) override {
+        b2Body* body = obstacles[obstacle];
+        b2AABB old = obstacleBoxes[obstacle];
+        obstacleBoxes[obstacle] = box;
+        b2Vec2 half = box.GetExtents(), oldHalf = old.GetExtents();
+        if (half.x != oldHalf.x || half.y != oldHalf.y) {
+            body->DestroyFixture(body->GetFixtureList());
+            createWallFixture(body, half.x, half.y);
+        }
+        body->SetTransform(box.GetCenter(), 0.0f);
+        wakeAround(old);
+        wakeAround(box);
+    }
+    void destroyObstacle(int obstacle) override {
+        world.DestroyBody(obstacles[obstacle]);
+        obstacles[obstacle] = NULL;
+        freeObstacles.push_back(obstacle);
+        wakeAround(obstacleBoxes[obstacle]);
+    }
+    BroadphaseStats getBroadphaseStats() const override {
+        return { world.GetTreeHeight(), world.GetTreeBalance(), world.GetTreeQuality(), world.GetProxyCount() };
+    }
+    // The tree's own RebuildBottomUp is out of reach behind b2World, so every
+    // circle leaves the tree and goes back in. Inserting them along a Z order
+    // curve puts neighbours next to each other, which keeps the new tree
+    // tight. Walls and obstacles stay where they are
+    void rebuildBroadphase() override {
+        if (bodies.empty()) return;
+        b2Vec2 lower = bodies[0]->GetPosition(), upper = lower;
+        for (b2Body* body : bodies) {
+            lower = b2Min(lower, body->GetPosition());
+            upper = b2Max(upper, body->GetPosition());
+        }
+        float scaleX = 65535.0f / b2Max(upper.x - lower.x, b2_epsilon), scaleY = 65535.0f / b2Max(upper.y - lower.y, b2_epsilon);
+        rebuildOrder.clear();
+        for (size_t i = 0; i < bodies.size(); i++) {
+            b2Vec2 position = bodies[i]->GetPosition();
+            Uint32 key = mortonKey((Uint32)((position.x - lower.x) * scaleX), (Uint32)((position.y - lower.y) * scaleY));
+            rebuildOrder.push_back((Uint64)key << 32 | i);
+        }
+        std::sort(rebuildOrder.begin(), rebuildOrder.end());
+        for (b2Body* body : bodies) body->SetEnabled(false);
+        for (Uint64 entry : rebuildOrder) bodies[(Uint32)entry]->SetEnabled(true);
+    }
+    void debugDraw(b2Draw& draw) override {
+        world.SetDebugDraw(&draw);
+        world.DebugDraw();
+        world.SetDebugDraw(NULL);
+        if (!(draw.GetFlags() & b2Draw::e_pairBit)) return;
+        b2WorldManifold manifold;
+        for (b2Contact* contact = world.GetContactList(); contact; contact = contact->GetNext()) {
+            if (!contact->IsTouching()) continue;
+            contact->GetWorldManifold(&manifold);
+            for (int i = 0; i < contact->GetManifold()->pointCount; i++) draw.DrawPoint(manifold.points[i], CONTACT_POINT_SIZE, b2Color(1.0f, 0.9f, 0.2f));
+        }
+    }
+    // Box2D only updates contacts of awake bodies, sleeping ones would stay
+    // inside a box that moved onto them or hang where one went away
+    void wakeAround(const b2AABB& box) {
+        found.clear();
+        queryAABB(widened(box, OBSTACLE_WAKE_MARGIN), found);
+        for (int body : found) bodies[body]->SetAwake(true);
+    }
+};
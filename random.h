@@ -0,0 +1,147 @@
+#pragma once
+
+#include <SDL2/SDL_stdinc.h>
+#include <emmintrin.h>
+
+// SplitMix64, only used to expand a seed into generator state
+inline Uint64 splitMix64(Uint64& x)
+{
+    Uint64 z = (x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+inline Uint32 rotateLeft(Uint32 x, int k)
+{
+    return (x << k) | (x >> (32 - k));
+}
+
+// xoshiro128** with an explicit seed. Each subsystem gets its own instance so
+// drawing more numbers in one doesn't shift the sequence of another
+struct Rng
+{
+    Uint32 state[4];
+
+    explicit Rng(Uint64 seed = 1) {
+        reseed(seed);
+    }
+    void reseed(Uint64 seed) {
+        Uint64 a = splitMix64(seed);
+        Uint64 b = splitMix64(seed);
+        state[0] = (Uint32)a;
+        state[1] = (Uint32)(a >> 32);
+        state[2] = (Uint32)b;
+        state[3] = (Uint32)(b >> 32);
+    }
+    Uint32 next() {
+        Uint32 result = rotateLeft(state[1] * 5, 7) * 9;
+        Uint32 t = state[1] << 9;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotateLeft(state[3], 11);
+        return result;
+    }
+    // Unbiased number in [0, bound) using Lemire's multiply and reject method
+    Uint32 below(Uint32 bound) {
+        Uint64 m = (Uint64)next() * bound;
+        Uint32 low = (Uint32)m;
+        if (low < bound) {
+            Uint32 threshold = (0u - bound) % bound;
+            while (low < threshold) {
+                m = (Uint64)next() * bound;
+                low = (Uint32)m;
+            }
+        }
+        return (Uint32)(m >> 32);
+    }
+    // Inclusive on both ends, like the old randomNum
+    int range(int lower, int upper) {
+        return lower + (int)below((Uint32)(upper - lower) + 1);
+    }
+    // Uniform float in [0, 1) from the top 24 bits
+    float uniform() {
+        return (next() >> 8) * (1.0f / 16777216.0f);
+    }
+};
+
+// Four xoshiro128+ generators in SSE lanes for filling large arrays. The lane
+// states are drawn from a scalar Rng so a batch is as reproducible as its seed
+struct RngBatch
+{
+    __m128i s0, s1, s2, s3;
+
+    explicit RngBatch(Rng& seeder) {
+        Uint32 lanes[16];
+        for (int i = 0; i < 16; i++) lanes[i] = seeder.next();
+        s0 = _mm_loadu_si128((const __m128i*)(lanes + 0));
+        s1 = _mm_loadu_si128((const __m128i*)(lanes + 4));
+        s2 = _mm_loadu_si128((const __m128i*)(lanes + 8));
+        s3 = _mm_loadu_si128((const __m128i*)(lanes + 12));
+    }
+    __m128i next() {
+        __m128i result = _mm_add_epi32(s0, s3);
+        __m128i t = _mm_slli_epi32(s1, 9);
+        s2 = _mm_xor_si128(s2, s0);
+        s3 = _mm_xor_si128(s3, s1);
+        s1 = _mm_xor_si128(s1, s2);
+        s0 = _mm_xor_si128(s0, s3);
+        s2 = _mm_xor_si128(s2, t);
+        s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+        return result;
+    }
+    // Integers in [lower, upper] from the high half of a 32x32 multiply. The
+    // bias is at most span / 2^32, which is not worth a rejection loop here
+    void fillRange(int* out, int count, int lower, int upper) {
+        __m128i bound = _mm_set1_epi32((int)((Uint32)(upper - lower) + 1));
+        __m128i offset = _mm_set1_epi32(lower);
+        __m128i oddMask = _mm_set_epi32(-1, 0, -1, 0);
+        for (int i = 0; i < count; i += 4) {
+            __m128i r = next();
+            __m128i even = _mm_srli_epi64(_mm_mul_epu32(r, bound), 32);
+            __m128i odd = _mm_and_si128(_mm_mul_epu32(_mm_srli_epi64(r, 32), bound), oddMask);
+            __m128i values = _mm_add_epi32(_mm_or_si128(even, odd), offset);
+            store(out + i, count - i, values);
+        }
+    }
+    void fillUniform(float* out, int count, float lower, float upper) {
+        __m128 scale = _mm_set1_ps((upper - lower) / 16777216.0f);
+        __m128 offset = _mm_set1_ps(lower);
+        for (int i = 0; i < count; i += 4) {
+            __m128 unit = _mm_cvtepi32_ps(_mm_srli_epi32(next(), 8));
+            __m128 values = _mm_add_ps(_mm_mul_ps(unit, scale), offset);
+            store(out + i, count - i, _mm_castps_si128(values));
+        }
+    }
+private:
+    template <typename T>
+    static void store(T* out, int remaining, __m128i values) {
+        if (remaining >= 4) {
+            _mm_storeu_si128((__m128i*)out, values);
+            return;
+        }
+        T lanes[4];
+        _mm_storeu_si128((__m128i*)lanes, values);
+        for (int i = 0; i < remaining; i++) out[i] = lanes[i];
+    }
+};
+
+// One stream per subsystem, all derived from a single seed
+struct RandomStreams
+{
+    Rng spawn;
+    Rng color;
+    Rng audio;
+
+    explicit RandomStreams(Uint64 seed) {
+        reseed(seed);
+    }
+    void reseed(Uint64 seed) {
+        spawn.reseed(splitMix64(seed));
+        color.reseed(splitMix64(seed));
+        audio.reseed(splitMix64(seed));
+    }
+};
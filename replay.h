@@ -0,0 +1,235 @@
+#pragma once
+
+#include "physics.h"
+#include <SDL2/SDL.h>
+#include <string>
+#include <vector>
+
+enum SimEventType : Uint8
+{
+    EVENT_SPAWN = 1,
+    // 2 was a force on one circle, which nothing ever recorded
+    EVENT_KEY = 3,
+    EVENT_END = 4,
+    EVENT_WELL = 5,
+    EVENT_CURSOR = 6,
+};
+
+// Something that changed the simulation from outside, keyed by the step it was
+// applied before. Only the fields of its type are meaningful
+struct SimEvent
+{
+    Uint32 step;
+    Uint8 type;
+    float x, y;           // Spawn, gravity well or cursor position in pixels
+    float forceX, forceY; // Spawn impulse
+    Uint8 radius;
+    Uint8 red, green, blue;
+    Uint16 category;      // Collision category of a spawned circle
+    Uint8 shape;          // ShapeType of a spawn
+    Uint8 sides;          // Corners of a spawned polygon
+    Sint32 key;
+    Uint8 cursorMode;     // A CursorMode
+    Uint64 hash;          // State hash at the end of a recording
+};
+
+inline void writeFloat(SDL_RWops* file, float value)
+{
+    Uint32 bits;
+    SDL_memcpy(&bits, &value, sizeof(bits));
+    SDL_WriteLE32(file, bits);
+}
+
+inline float readFloat(SDL_RWops* file)
+{
+    Uint32 bits = SDL_ReadLE32(file);
+    float value;
+    SDL_memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// A recorded session: the seed, the fixed step rate, the command line flags
+// that decide how the world behaves and every event in step order. On disk it
+// is a small header followed by variable sized records that only carry the
+// fields of their type, all little endian
+struct EventLog
+{
+    static const Uint32 MAGIC = 0x474C4F42; // "BOLG"
+    static const Uint16 VERSION = 4; // Version 1 spawns had no category, 2 no shape, 3 no flags
+    static const int HEADER_SIZE = 20; // Without the flags
+
+    Uint16 version = VERSION; // Of the file it was loaded from
+    Uint64 seed = 1;
+    Uint16 stepRate = 60;
+    std::vector<std::string> flags; // Names and values as they were on the command line
+    std::vector<SimEvent> events;
+
+    void push(const SimEvent& event) {
+        events.push_back(event);
+    }
+
+    bool save(const char* path) const {
+        SDL_RWops* file = SDL_RWFromFile(path, "wb");
+        if (!file) return false;
+        SDL_WriteLE32(file, MAGIC);
+        SDL_WriteLE16(file, VERSION);
+        SDL_WriteLE16(file, stepRate);
+        SDL_WriteLE64(file, seed);
+        SDL_WriteLE16(file, (Uint16)flags.size());
+        for (const std::string& flag : flags) {
+            Uint8 length = (Uint8)SDL_min(flag.size(), (size_t)255);
+            SDL_WriteU8(file, length);
+            SDL_RWwrite(file, flag.data(), 1, length);
+        }
+        SDL_WriteLE32(file, (Uint32)events.size());
+        for (const SimEvent& event : events) {
+            SDL_WriteLE32(file, event.step);
+            SDL_WriteU8(file, event.type);
+            switch (event.type) {
+            case EVENT_SPAWN:
+                writeFloat(file, event.x);
+                writeFloat(file, event.y);
+                writeFloat(file, event.forceX);
+                writeFloat(file, event.forceY);
+                SDL_WriteU8(file, event.radius);
+                SDL_WriteU8(file, event.red);
+                SDL_WriteU8(file, event.green);
+                SDL_WriteU8(file, event.blue);
+                SDL_WriteLE16(file, event.category);
+                SDL_WriteU8(file, event.shape);
+                SDL_WriteU8(file, event.sides);
+                break;
+            case EVENT_KEY:
+                SDL_WriteLE32(file, (Uint32)event.key);
+                break;
+            case EVENT_END:
+                SDL_WriteLE64(file, event.hash);
+                break;
+            case EVENT_WELL:
+                writeFloat(file, event.x);
+                writeFloat(file, event.y);
+                break;
+            case EVENT_CURSOR:
+                writeFloat(file, event.x);
+                writeFloat(file, event.y);
+                SDL_WriteU8(file, event.cursorMode);
+                break;
+            }
+        }
+        return SDL_RWclose(file) == 0;
+    }
+
+    // Bytes a record of type takes after its step and type, -1 for unknown types
+    static int payloadSize(Uint8 type, Uint16 version) {
+        switch (type) {
+        case EVENT_SPAWN: return 20 + (version >= 2 ? 2 : 0) + (version >= 3 ? 2 : 0);
+        case EVENT_KEY: return 4;
+        case EVENT_END: return 8;
+        case EVENT_WELL: return 8;
+        case EVENT_CURSOR: return 9;
+        default: return -1;
+        }
+    }
+
+    // Every record is checked against what is left of the file before it is
+    // read, so a cut off or corrupt log fails instead of reading zeros
+    bool load(const char* path) {
+        SDL_RWops* file = SDL_RWFromFile(path, "rb");
+        if (!file) return false;
+        Uint32 magic = SDL_ReadLE32(file);
+        version = SDL_ReadLE16(file);
+        if (magic != MAGIC || version < 1 || version > VERSION) {
+            SDL_SetError("%s is not an event log up to version %d", path, VERSION);
+            SDL_RWclose(file);
+            return false;
+        }
+        stepRate = SDL_ReadLE16(file);
+        seed = SDL_ReadLE64(file);
+        Sint64 size = SDL_RWsize(file);
+        flags.clear();
+        Uint16 flagCount = version >= 4 ? SDL_ReadLE16(file) : 0;
+        for (Uint16 i = 0; i < flagCount; i++) {
+            std::string flag(SDL_ReadU8(file), '\0');
+            if (SDL_RWtell(file) + (Sint64)flag.size() > size || (!flag.empty() && SDL_RWread(file, &flag[0], 1, flag.size()) != flag.size())) {
+                SDL_SetError("%s is cut off in its flags", path);
+                SDL_RWclose(file);
+                return false;
+            }
+            flags.push_back(flag);
+        }
+        bool fits = size >= HEADER_SIZE && SDL_RWtell(file) + 4 <= size;
+        Uint32 count = SDL_ReadLE32(file);
+        // Records take at least their step and type
+        if (stepRate == 0 || !fits || SDL_RWtell(file) + (Sint64)count * 5 > size) {
+            SDL_SetError("%s is not a valid event log", path);
+            SDL_RWclose(file);
+            return false;
+        }
+        events.clear();
+        events.reserve(count);
+        for (Uint32 i = 0; i < count; i++) {
+            SimEvent event = {};
+            bool fits = SDL_RWtell(file) + 5 <= size;
+            if (fits) {
+                event.step = SDL_ReadLE32(file);
+                event.type = SDL_ReadU8(file);
+                int payload = payloadSize(event.type, version);
+                fits = payload < 0 || SDL_RWtell(file) + payload <= size;
+            }
+            if (!fits) {
+                SDL_SetError("%s is cut off after %u of %u events", path, i, count);
+                SDL_RWclose(file);
+                return false;
+            }
+            switch (event.type) {
+            case EVENT_SPAWN:
+                event.x = readFloat(file);
+                event.y = readFloat(file);
+                event.forceX = readFloat(file);
+                event.forceY = readFloat(file);
+                event.radius = SDL_ReadU8(file);
+                event.red = SDL_ReadU8(file);
+                event.green = SDL_ReadU8(file);
+                event.blue = SDL_ReadU8(file);
+                event.category = version >= 2 ? SDL_ReadLE16(file) : CATEGORY_CIRCLE;
+                event.shape = version >= 3 ? SDL_ReadU8(file) : (Uint8)SHAPE_CIRCLE;
+                event.sides = version >= 3 ? SDL_ReadU8(file) : 0;
+                break;
+            case EVENT_KEY:
+                event.key = (Sint32)SDL_ReadLE32(file);
+                break;
+            case EVENT_END:
+                event.hash = SDL_ReadLE64(file);
+                break;
+            case EVENT_WELL:
+                event.x = readFloat(file);
+                event.y = readFloat(file);
+                break;
+            case EVENT_CURSOR:
+                event.x = readFloat(file);
+                event.y = readFloat(file);
+                event.cursorMode = SDL_ReadU8(file);
+                break;
+            default:
+                SDL_SetError("Unknown event type %d in %s", event.type, path);
+                SDL_RWclose(file);
+                return false;
+            }
+            events.push_back(event);
+        }
+        SDL_RWclose(file);
+        return true;
+    }
+};
+
+// FNV-1a, used to check that a replay ended in exactly the recorded state
+inline void hashBytes(Uint64& hash, const void* data, size_t size)
+{
+    const Uint8* bytes = (const Uint8*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+}
+
+const Uint64 HASH_SEED = 0xCBF29CE484222325ull;
@@ -0,0 +1,36 @@
+//{{NO_DEPENDENCIES}}
+// Resource IDs for BouncyOverlay.rc
+
+// The plops are numbered consecutively so they can be loaded in a loop
+#define IDR_PLOP_FIRST                  101
+#define IDR_PLOP_01                     101
+#define IDR_PLOP_02                     102
+#define IDR_PLOP_03                     103
+#define IDR_PLOP_04                     104
+#define IDR_PLOP_05                     105
+#define IDR_PLOP_06                     106
+#define IDR_PLOP_07                     107
+#define IDR_PLOP_08                     108
+#define IDR_PLOP_09                     109
+#define IDR_PLOP_10                     110
+#define IDR_PLOP_11                     111
+#define IDR_PLOP_12                     112
+#define IDR_PLOP_13                     113
+#define IDR_PLOP_14                     114
+#define IDR_PLOP_15                     115
+#define IDR_PLOP_16                     116
+#define IDR_PLOP_17                     117
+#define IDR_PLOP_18                     118
+#define IDR_PLOP_19                     119
+#define IDR_PLOP_20                     120
+#define IDR_PLOP_21                     121
+#define IDR_PLOP_22                     122
+#define IDR_PLOP_23                     123
+#define IDR_PLOP_24                     124
+#define IDR_PLOP_25                     125
+#define IDR_PLOP_26                     126
+#define IDR_PLOP_27                     127
+#define IDR_PLOP_28                     128
+#define IDR_PLOP_29                     129
+#define IDR_PLOP_30                     130
+#define IDR_PLOP_31                     131
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <SDL2/SDL_stdinc.h>
+#include <box2d/box2d.h>
+#include <math.h>
+#include <vector>
+
+// Shapes a body can have, each one sized by a radius r
+enum ShapeType : Uint8
+{
+    SHAPE_CIRCLE = 0,
+    SHAPE_BOX = 1,     // 2r wide and r high
+    SHAPE_POLYGON = 2, // Regular, corners r from the center
+    SHAPE_CAPSULE = 3, // Caps of r / 2 with centers r apart, 2r long overall
+};
+const int SHAPE_TYPE_COUNT = 4;
+const Uint8 SHAPES_CIRCLES_ONLY = 1 << SHAPE_CIRCLE;
+const int MIN_POLYGON_SIDES = 3;
+const int CIRCLE_SEGMENTS = 64;       // Plenty for the 25 pixels the largest spawn gets
+const int CAPSULE_CAP_SEGMENTS = 16;
+
+// In world units, sides only matters for polygons
+struct BodyShape
+{
+    ShapeType type;
+    float radius;
+    int sides;
+};
+
+// Farthest any point of the shape gets from its center
+inline float boundingRadius(const BodyShape& shape)
+{
+    return shape.type == SHAPE_BOX ? shape.radius * 1.1180340f : shape.radius;
+}
+
+// The convex outline of a shape of radius 1 in its own frame. Box2D builds
+// boxes and polygons from the same points the renderer triangulates
+inline void unitOutline(ShapeType type, int sides, std::vector<b2Vec2>& outline)
+{
+    outline.clear();
+    switch (type) {
+    case SHAPE_CIRCLE:
+        for (int i = 0; i < CIRCLE_SEGMENTS; i++) {
+            float theta = 2.0f * b2_pi * i / CIRCLE_SEGMENTS;
+            outline.push_back(b2Vec2(cosf(theta), sinf(theta)));
+        }
+        break;
+    case SHAPE_BOX:
+        outline.push_back(b2Vec2(-1.0f, -0.5f));
+        outline.push_back(b2Vec2(1.0f, -0.5f));
+        outline.push_back(b2Vec2(1.0f, 0.5f));
+        outline.push_back(b2Vec2(-1.0f, 0.5f));
+        break;
+    case SHAPE_POLYGON:
+        sides = SDL_clamp(sides, MIN_POLYGON_SIDES, b2_maxPolygonVertices);
+        for (int i = 0; i < sides; i++) {
+            float theta = 2.0f * b2_pi * i / sides;
+            outline.push_back(b2Vec2(cosf(theta), sinf(theta)));
+        }
+        break;
+    case SHAPE_CAPSULE:
+        // Right cap from bottom to top, then the left one from top to bottom
+        for (int cap = 0; cap < 2; cap++) {
+            float center = cap == 0 ? 0.5f : -0.5f;
+            for (int i = 0; i <= CAPSULE_CAP_SEGMENTS; i++) {
+                float theta = b2_pi * (cap - 0.5f + (float)i / CAPSULE_CAP_SEGMENTS);
+                outline.push_back(b2Vec2(center + 0.5f * cosf(theta), 0.5f * sinf(theta)));
+            }
+        }
+        break;
+    }
+}
+
+// Triangle lists of every shape at radius 1, built once and shared by every
+// body of that shape. Each polygon corner count gets a mesh of its own
+struct ShapeMeshes
+{
+    struct Mesh
+    {
+        int first, count; // Vertices
+    };
+
+    std::vector<b2Vec2> vertices;
+    std::vector<Mesh> meshes;
+
+    ShapeMeshes() {
+        add(SHAPE_CIRCLE, 0);
+        add(SHAPE_BOX, 0);
+        add(SHAPE_CAPSULE, 0);
+        for (int sides = MIN_POLYGON_SIDES; sides <= b2_maxPolygonVertices; sides++) add(SHAPE_POLYGON, sides);
+    }
+
+    // Every outline is convex, so a fan from its first point covers it
+    void add(ShapeType type, int sides) {
+        std::vector<b2Vec2> outline;
+        unitOutline(type, sides, outline);
+        Mesh mesh = { (int)vertices.size(), 3 * ((int)outline.size() - 2) };
+        for (size_t i = 1; i + 1 < outline.size(); i++) {
+            vertices.push_back(outline[0]);
+            vertices.push_back(outline[i]);
+            vertices.push_back(outline[i + 1]);
+        }
+        meshes.push_back(mesh);
+    }
+
+    // Circles, boxes and capsules come first, then the polygons by corner count
+    static int index(ShapeType type, int sides) {
+        switch (type) {
+        case SHAPE_BOX: return 1;
+        case SHAPE_CAPSULE: return 2;
+        case SHAPE_POLYGON: return 3 + SDL_clamp(sides, MIN_POLYGON_SIDES, b2_maxPolygonVertices) - MIN_POLYGON_SIDES;
+        default: return 0;
+        }
+    }
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <emmintrin.h>
+
+// Sums the four lanes, SSE2 has no horizontal add
+inline float horizontalSum(__m128 v)
+{
+    __m128 shuffled = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(v, shuffled);
+    shuffled = _mm_movehl_ps(shuffled, sums);
+    return _mm_cvtss_f32(_mm_add_ss(sums, shuffled));
+}
+
+// a where mask is set, b elsewhere
+inline __m128 selectLanes(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <windows.h>
+#include <vector>
+
+// One body, stored exactly as it is laid out in memory so a mapped file can be
+// read in place. All fields are little endian, which every x64 target is
+struct SnapshotBody
+{
+    float x, y;         // Position in world units
+    float angle;
+    float velocityX, velocityY;
+    float angularVelocity;
+    float radius;       // Pixels
+    Uint8 red, green, blue;
+    Uint8 awake;
+    Uint8 shape;        // A ShapeType
+    Uint8 sides;        // Polygons only
+    Uint16 reserved;
+};
+static_assert(sizeof(SnapshotBody) == 36, "SnapshotBody must stay tightly packed");
+
+struct SnapshotHeader
+{
+    Uint32 magic;
+    Uint16 version;
+    Uint16 bodySize;
+    Uint32 bodyCount;
+    Sint32 width, height; // Screen the snapshot was taken on
+    Uint32 reserved;
+};
+static_assert(sizeof(SnapshotHeader) == 24, "SnapshotHeader must stay tightly packed");
+
+const Uint32 SNAPSHOT_MAGIC = 0x534E4F42; // "BONS"
+const Uint16 SNAPSHOT_VERSION = 2; // Version 1 had circles only
+
+// Writes the header and the body array in two calls
+inline bool saveSnapshot(const char* path, const std::vector<SnapshotBody>& bodies, int width, int height)
+{
+    SDL_RWops* file = SDL_RWFromFile(path, "wb");
+    if (!file) return false;
+    SnapshotHeader header = { SNAPSHOT_MAGIC, SNAPSHOT_VERSION, sizeof(SnapshotBody), (Uint32)bodies.size(), width, height, 0 };
+    bool written = SDL_RWwrite(file, &header, sizeof(header), 1) == 1;
+    if (written && !bodies.empty()) written = SDL_RWwrite(file, bodies.data(), sizeof(SnapshotBody), bodies.size()) == bodies.size();
+    return SDL_RWclose(file) == 0 && written;
+}
+
+// A read only view of a snapshot file, valid until close()
+struct MappedSnapshot
+{
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+    const void* view = NULL;
+    const SnapshotHeader* header = NULL;
+    const SnapshotBody* bodies = NULL;
+
+    bool open(const char* path) {
+        file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart < (LONGLONG)sizeof(SnapshotHeader)) {
+            close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+        if (!view) {
+            close();
+            return false;
+        }
+
+        header = (const SnapshotHeader*)view;
+        LONGLONG expected = sizeof(SnapshotHeader) + (LONGLONG)header->bodyCount * sizeof(SnapshotBody);
+        if (header->magic != SNAPSHOT_MAGIC || header->version != SNAPSHOT_VERSION ||
+            header->bodySize != sizeof(SnapshotBody) || size.QuadPart < expected) {
+            close();
+            return false;
+        }
+        bodies = (const SnapshotBody*)(header + 1);
+        return true;
+    }
+
+    void close() {
+        if (view) UnmapViewOfFile(view);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+        mapping = NULL;
+        view = NULL;
+        header = NULL;
+        bodies = NULL;
+    }
+};
@@ -0,0 +1,222 @@
+#pragma once
+
+#include "physics.h"
+#include <SDL2/SDL.h>
+#include <box2d/box2d.h>
+#include <box2d/b2_rope.h>
+#include <algorithm>
+#include <vector>
+
+const int MIN_BLOB_PARTICLES = 6;
+const int MAX_BLOB_PARTICLES = 24;  // Each particle brings two and a half joints
+const int MAX_ROPE_SEGMENTS = 32;
+const int MAX_ROPE_ITERATIONS = 16;
+const float BLOB_HERTZ = 4.0f;
+const float BLOB_DAMPING_RATIO = 0.3f;
+const float ROPE_GRAVITY = 9.8f;    // The world has none, ropes hang down anyway
+const float ROPE_PARTICLE_RADIUS = 2.0f / PIXELS_PER_METER;
+
+struct SoftSettings
+{
+    int blobs = 0;           // Dropped in at the start
+    int blobParticles = 12;
+    int ropeSegments = 12;
+    float ropeLength = 1.5f; // World units
+    int iterations = 4;      // Most solver iterations a rope gets per step
+    int budget = 16;         // Soft bodies simulated at once
+    int ropes = 0;           // Circles that get a rope, in spawn order
+};
+
+// A ring of circles held together by soft distance joints to their
+// neighbours, to the ones after those and to the one across. The circles
+// are bodies of the world like any other, first to first + count - 1
+struct SoftBlob
+{
+    int first, count;
+    float activity = 0.0f;
+    bool awake = true;    // Any of its circles was, after the last step
+    bool inBudget = true;
+};
+
+// b2Rope keeps its particles to itself and only hands them out through
+// Draw, which reports them as points in order
+struct RopePoints : b2Draw
+{
+    std::vector<b2Vec2>* points;
+
+    void DrawPolygon(const b2Vec2*, int32, const b2Color&) override {}
+    void DrawSolidPolygon(const b2Vec2*, int32, const b2Color&) override {}
+    void DrawCircle(const b2Vec2&, float, const b2Color&) override {}
+    void DrawSolidCircle(const b2Vec2&, float, const b2Vec2&, const b2Color&) override {}
+    void DrawSegment(const b2Vec2&, const b2Vec2&, const b2Color&) override {}
+    void DrawTransform(const b2Transform&) override {}
+    void DrawPoint(const b2Vec2& p, float, const b2Color&) override {
+        points->push_back(p);
+    }
+};
+
+// A chain hanging from a body. Ropes never touch anything, they only follow
+// the body they hang from, so they can't change how the world plays out
+struct SoftRope
+{
+    b2Rope rope;
+    int anchor;
+    b2Color color;
+    std::vector<b2Vec2> points;
+    b2Vec2 steppedAt; // Where the anchor was when the points were taken
+    float activity = 0.0f;
+    bool active = true;
+};
+
+// Blobs and ropes under one budget of bodies simulated at once. Every step
+// they are ranked, blobs knocked awake from outside the budget first, then
+// the awake blobs and the ropes by how much they move, then sleeping blobs.
+// A knocked blob so takes the slot of the least busy one, which is put to
+// sleep as it leaves the budget, and reacts to the hit instead of having
+// its velocity zeroed. Ropes past the budget keep their shape and are
+// carried along with their anchor. Ropes are solved with at most iterations
+// iterations each, blobs in the world's own solver, which sizes cannot go
+// past MAX_BLOB_PARTICLES
+struct SoftBodies
+{
+    SoftSettings settings;
+    std::vector<SoftBlob> blobs;
+    std::vector<SoftRope*> ropes;
+    struct Ranked
+    {
+        int tier; // 2 knocked blobs, 1 awake blobs and ropes, 0 sleeping blobs
+        float activity;
+        int index; // Blobs first, then ropes
+    };
+    std::vector<Ranked> ranking;
+    RopePoints reader;
+
+    // activeTotal counts the blobs that were awake and the ropes that were stepped
+    Uint64 steps = 0, activeTotal = 0, frozen = 0, ropeSteps = 0, ropeTicks = 0;
+
+    explicit SoftBodies(const SoftSettings& settings) : settings(settings) {}
+    ~SoftBodies() {
+        for (SoftRope* rope : ropes) delete rope;
+    }
+
+    bool wantsRope() const {
+        return (int)ropes.size() < settings.ropes;
+    }
+
+    // Joins a ring of count bodies, first to first + count - 1, that are
+    // already in place. The engine has to have joints
+    void addBlob(PhysicsWorld& world, int first, int count) {
+        for (int i = 0; i < count; i++) {
+            world.createSpring(first + i, first + (i + 1) % count, BLOB_HERTZ, BLOB_DAMPING_RATIO);
+            world.createSpring(first + i, first + (i + 2) % count, BLOB_HERTZ, BLOB_DAMPING_RATIO);
+            if (i < count / 2) world.createSpring(first + i, first + i + count / 2, BLOB_HERTZ, BLOB_DAMPING_RATIO);
+        }
+        SoftBlob blob;
+        blob.first = first;
+        blob.count = count;
+        blobs.push_back(blob);
+    }
+
+    // Hangs straight down from the anchor, which holds its first particle
+    void addRope(PhysicsWorld& world, int anchor, const b2Color& color) {
+        int count = SDL_clamp(settings.ropeSegments, 2, MAX_ROPE_SEGMENTS) + 1;
+        std::vector<b2Vec2> vertices(count);
+        std::vector<float> masses(count, 1.0f);
+        masses[0] = 0.0f;
+        for (int i = 0; i < count; i++) vertices[i].Set(0.0f, settings.ropeLength * i / (count - 1));
+
+        SoftRope* rope = new SoftRope();
+        b2RopeDef def;
+        def.position = world.getPosition(anchor);
+        def.vertices = vertices.data();
+        def.count = count;
+        def.masses = masses.data();
+        def.gravity.Set(0.0f, ROPE_GRAVITY);
+        def.tuning.damping = 0.1f;
+        rope->rope.Create(def);
+        rope->anchor = anchor;
+        rope->color = color;
+        rope->steppedAt = def.position;
+        readPoints(*rope);
+        ropes.push_back(rope);
+    }
+
+    void update(PhysicsWorld& world, float deltaTime) {
+        steps++;
+        ranking.clear();
+        for (size_t b = 0; b < blobs.size(); b++) {
+            SoftBlob& blob = blobs[b];
+            float speed = 0.0f;
+            blob.awake = false;
+            for (int i = blob.first; i < blob.first + blob.count; i++) {
+                BodyState state = world.getState(i);
+                speed += state.velocity.Length();
+                blob.awake |= state.awake;
+            }
+            blob.activity = speed / blob.count;
+            if (blob.awake) activeTotal++;
+            ranking.push_back({ blob.awake ? (blob.inBudget ? 1 : 2) : 0, blob.activity, (int)b });
+        }
+        for (size_t r = 0; r < ropes.size(); r++) {
+            ropes[r]->activity = world.getState(ropes[r]->anchor).velocity.Length();
+            ranking.push_back({ 1, ropes[r]->activity, (int)(blobs.size() + r) });
+        }
+
+        // Ties keep their order so the ranking doesn't flicker
+        int budget = SDL_min(settings.budget, (int)ranking.size());
+        std::stable_sort(ranking.begin(), ranking.end(), [](const Ranked& a, const Ranked& b) {
+            return a.tier != b.tier ? a.tier > b.tier : a.activity > b.activity;
+        });
+        for (size_t i = 0; i < ranking.size(); i++) {
+            bool active = (int)i < budget;
+            int index = ranking[i].index;
+            if (index >= (int)blobs.size()) {
+                ropes[index - blobs.size()]->active = active;
+                continue;
+            }
+            // Knocked blobs rank first, so this evicts the least busy blob that
+            // had a slot, and only holds a knocked one asleep when more were
+            // knocked at once than the budget has room for
+            SoftBlob& blob = blobs[index];
+            if (!active && blob.awake) freeze(world, blob);
+            blob.inBudget = active;
+        }
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        int iterations = SDL_clamp(settings.iterations, 1, MAX_ROPE_ITERATIONS);
+        for (SoftRope* rope : ropes) {
+            if (!rope->active) continue;
+            rope->steppedAt = world.getPosition(rope->anchor);
+            rope->rope.Step(deltaTime, iterations, rope->steppedAt);
+            readPoints(*rope);
+            ropeSteps++;
+            activeTotal++;
+        }
+        ropeTicks += SDL_GetPerformanceCounter() - start;
+    }
+
+    void freeze(PhysicsWorld& world, SoftBlob& blob) {
+        for (int i = blob.first; i < blob.first + blob.count; i++) world.setLod(i, LOD_FROZEN);
+        blob.awake = false;
+        frozen++;
+    }
+
+    void readPoints(SoftRope& rope) {
+        rope.points.clear();
+        reader.points = &rope.points;
+        rope.rope.Draw(&reader);
+    }
+
+    // Where a rope particle is drawn, one left out of the budget moves with its anchor
+    b2Vec2 ropePoint(const PhysicsWorld& world, const SoftRope& rope, int i) const {
+        if (rope.active) return rope.points[i];
+        return rope.points[i] + world.getPosition(rope.anchor) - rope.steppedAt;
+    }
+
+    void logStats() const {
+        if (steps == 0) return;
+        SDL_Log("Soft bodies: %d blobs and %d ropes, %.1f simulated per step against a budget of %d, blobs put to sleep %llu times, %.4f ms per rope step",
+            (int)blobs.size(), (int)ropes.size(), (double)activeTotal / steps, settings.budget, (unsigned long long)frozen,
+            ropeSteps ? ropeTicks * 1000.0 / SDL_GetPerformanceFrequency() / ropeSteps : 0.0);
+    }
+};
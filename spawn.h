@@ -0,0 +1,92 @@
+#pragma once
+
+#include "physics.h"
+#include "random.h"
+#include <SDL2/SDL_stdinc.h>
+#include <algorithm>
+#include <vector>
+
+// Grows capacity at least geometrically, so spawning in small batches doesn't
+// reallocate on every one
+template <typename T>
+inline void reserveFor(std::vector<T>& values, size_t needed)
+{
+    if (values.capacity() < needed) values.reserve(SDL_max(needed, 2 * values.capacity()));
+}
+
+// Where circles of a batch appear and how hard they get thrown, in pixels and
+// Newtons. Everything is drawn uniformly from these ranges
+struct SpawnDistribution
+{
+    float left, top, right, bottom;
+    int minRadius = 5, maxRadius = 25;
+    int maxForce = 1000;
+    Uint16 category = CATEGORY_CIRCLE;
+    Uint8 shapes = SHAPES_CIRCLES_ONLY; // Mask of ShapeTypes, each equally likely
+
+    SpawnDistribution(float left, float top, float right, float bottom) : left(left), top(top), right(right), bottom(bottom) {}
+};
+
+// The random part of a batch of spawns, drawn in bulk from SSE generators
+// seeded off the simulation's streams
+struct SpawnBatch
+{
+    int count = 0;
+    std::vector<float> x, y;
+    std::vector<int> forceX, forceY, radius;
+    std::vector<int> red, green, blue;
+    std::vector<int> shape, sides;
+
+    void generate(int count, const SpawnDistribution& distribution, Rng& spawn, Rng& color) {
+        this->count = count;
+        for (std::vector<float>* array : { &x, &y }) array->resize(count);
+        for (std::vector<int>* array : { &forceX, &forceY, &radius, &red, &green, &blue, &shape, &sides }) array->resize(count);
+
+        RngBatch spawnLanes(spawn);
+        spawnLanes.fillUniform(x.data(), count, distribution.left, distribution.right);
+        spawnLanes.fillUniform(y.data(), count, distribution.top, distribution.bottom);
+        spawnLanes.fillRange(forceX.data(), count, -distribution.maxForce, distribution.maxForce);
+        spawnLanes.fillRange(forceY.data(), count, -distribution.maxForce, distribution.maxForce);
+        spawnLanes.fillRange(radius.data(), count, distribution.minRadius, distribution.maxRadius);
+        generateShapes(count, distribution.shapes, spawnLanes);
+
+        RngBatch colorLanes(color);
+        colorLanes.fillRange(red.data(), count, 0, 255);
+        colorLanes.fillRange(green.data(), count, 0, 255);
+        colorLanes.fillRange(blue.data(), count, 0, 255);
+    }
+
+    // Circles only draw nothing, so the spawns of a circle scene stay what
+    // they were before there were other shapes
+    void generateShapes(int count, Uint8 shapes, RngBatch& lanes) {
+        int types[SHAPE_TYPE_COUNT], typeCount = 0;
+        for (int type = 0; type < SHAPE_TYPE_COUNT; type++) {
+            if (shapes & (1 << type)) types[typeCount++] = type;
+        }
+        if (typeCount <= 1) {
+            std::fill(shape.begin(), shape.end(), typeCount ? types[0] : SHAPE_CIRCLE);
+            std::fill(sides.begin(), sides.end(), 0);
+            return;
+        }
+        lanes.fillRange(shape.data(), count, 0, typeCount - 1);
+        for (int& pick : shape) pick = types[pick];
+        lanes.fillRange(sides.data(), count, MIN_POLYGON_SIDES, b2_maxPolygonVertices);
+    }
+};
+
+// Turns a spawn rate into whole spawns per step. The fraction left over
+// carries into the next step, so the rate holds at any frame rate
+struct SpawnScheduler
+{
+    float rate;            // Circles per second
+    float pending = 0.0f;
+
+    explicit SpawnScheduler(float rate) : rate(rate) {}
+
+    int due(float deltaTime) {
+        pending += rate * deltaTime;
+        int count = (int)pending;
+        pending -= count;
+        return count;
+    }
+};
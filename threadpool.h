@@ -0,0 +1,145 @@
+#pragma once
+
+#include <SDL2/SDL_timer.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A contiguous range of chunks owned by one thread. The owner takes chunks
+// from the front, idle threads steal from the back
+struct WorkQueue
+{
+    std::mutex lock;
+    int begin = 0, end = 0;
+
+    bool pop(int& chunk) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (begin == end) return false;
+        chunk = begin++;
+        return true;
+    }
+    bool steal(int& chunk) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (begin == end) return false;
+        chunk = --end;
+        return true;
+    }
+};
+
+// Work stealing parallel for. The calling thread works as thread 0, so a pool
+// of size one runs everything inline. Jobs only decide how the range is split,
+// never what a chunk computes, so callers that write disjoint data get the
+// same result whatever the thread count
+struct ThreadPool
+{
+    std::vector<std::thread> threads;
+    WorkQueue* queues;
+    std::vector<Uint64> busyTicks; // Time each thread spent running chunks
+    int threadCount;
+
+    std::mutex wakeLock;
+    std::condition_variable wake, finished;
+    const std::function<void(int, int)>* job = NULL;
+    int itemCount = 0, grain = 1;
+    std::atomic<int> remaining;
+    int active = 0;
+    std::atomic<Uint64> generation;
+    std::atomic<bool> quit;
+
+    explicit ThreadPool(int threadCount) : threadCount(SDL_max(threadCount, 1)), remaining(0), generation(0), quit(false) {
+        queues = new WorkQueue[this->threadCount];
+        busyTicks.assign(this->threadCount, 0);
+        for (int i = 1; i < this->threadCount; i++) threads.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> guard(wakeLock);
+            quit = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads) thread.join();
+        delete[] queues;
+    }
+
+    // Calls fn(begin, end) on chunks of at most grain items until count is covered
+    void parallelFor(int count, int grain, const std::function<void(int, int)>& fn) {
+        if (count <= 0) return;
+        int chunks = (count + grain - 1) / grain;
+        if (threadCount == 1 || chunks == 1) {
+            Uint64 start = SDL_GetPerformanceCounter();
+            fn(0, count);
+            busyTicks[0] += SDL_GetPerformanceCounter() - start;
+            return;
+        }
+
+        {
+            std::unique_lock<std::mutex> guard(wakeLock);
+            finished.wait(guard, [this] { return active == 0; });
+            job = &fn;
+            itemCount = count;
+            this->grain = grain;
+            remaining = chunks;
+            for (int i = 0; i < threadCount; i++) {
+                queues[i].begin = (int)((long long)chunks * i / threadCount);
+                queues[i].end = (int)((long long)chunks * (i + 1) / threadCount);
+            }
+            generation++;
+        }
+        wake.notify_all();
+
+        runChunks(0);
+        std::unique_lock<std::mutex> guard(wakeLock);
+        finished.wait(guard, [this] { return remaining == 0 && active == 0; });
+    }
+
+    void resetTimings() {
+        busyTicks.assign(threadCount, 0);
+    }
+
+private:
+    void workerLoop(int index) {
+        Uint64 seen = 0;
+        while (true) {
+            // A physics step hands out many small jobs back to back, so spin a
+            // little before going to sleep
+            for (int spin = 0; spin < 1000 && generation == seen && !quit; spin++) std::this_thread::yield();
+            {
+                std::unique_lock<std::mutex> guard(wakeLock);
+                wake.wait(guard, [this, seen] { return quit || generation != seen; });
+                if (quit) return;
+                seen = generation;
+                active++;
+            }
+            runChunks(index);
+            {
+                std::lock_guard<std::mutex> guard(wakeLock);
+                active--;
+            }
+            finished.notify_all();
+        }
+    }
+
+    void runChunks(int index) {
+        int chunk;
+        while (queues[index].pop(chunk) || stealChunk(index, chunk)) {
+            Uint64 start = SDL_GetPerformanceCounter();
+            int begin = chunk * grain;
+            (*job)(begin, SDL_min(begin + grain, itemCount));
+            busyTicks[index] += SDL_GetPerformanceCounter() - start;
+            if (--remaining == 0) {
+                std::lock_guard<std::mutex> guard(wakeLock);
+                finished.notify_all();
+            }
+        }
+    }
+
+    bool stealChunk(int index, int& chunk) {
+        for (int i = 1; i < threadCount; i++) {
+            if (queues[(index + i) % threadCount].steal(chunk)) return true;
+        }
+        return false;
+    }
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+
+// The hotkeys walk through these
+const float TIME_SCALES[] = { 0.1f, 0.25f, 0.5f, 1.0f, 2.0f, 4.0f, 10.0f };
+const int TIME_SCALE_COUNT = sizeof(TIME_SCALES) / sizeof(TIME_SCALES[0]);
+const int MAX_STEPS_PER_FRAME = 20; // 10x at 30 frames a second
+
+// Turns the wall time of a frame into physics steps at a time scale. Slow
+// motion takes shorter or fewer steps, fast forward several per frame, and
+// only the state after the last one is drawn. When a frame would need more
+// than MAX_STEPS_PER_FRAME the rest is dropped instead of piling up, so the
+// simulated seconds per wall second show what the machine keeps up with
+struct TimeScale
+{
+    float scale;
+    float accumulator = 0.0f; // Simulated time not stepped yet, fixed steps only
+
+    // Since the scale last changed
+    double wallSeconds = 0.0, simulatedSeconds = 0.0;
+    Uint64 frames = 0, steps = 0, cappedFrames = 0;
+
+    explicit TimeScale(float scale) : scale(SDL_clamp(scale, TIME_SCALES[0], TIME_SCALES[TIME_SCALE_COUNT - 1])) {}
+
+    // Whole steps of fixedStep, the remainder carries into the next frame
+    int fixedSteps(float wallDelta, float fixedStep) {
+        accumulator += wallDelta * scale;
+        int due = (int)(accumulator / fixedStep);
+        if (due > MAX_STEPS_PER_FRAME) {
+            due = MAX_STEPS_PER_FRAME;
+            accumulator = 0.0f;
+            cappedFrames++;
+        }
+        else accumulator -= due * fixedStep;
+        count(wallDelta, due, fixedStep);
+        return due;
+    }
+
+    // Equal steps no longer than maxStep that cover the frame's scaled time
+    int variableSteps(float wallDelta, float maxStep, float& stepTime) {
+        float total = wallDelta * scale;
+        int due = SDL_max((int)SDL_ceilf(total / maxStep), 1);
+        if (due > MAX_STEPS_PER_FRAME) {
+            due = MAX_STEPS_PER_FRAME;
+            total = due * maxStep;
+            cappedFrames++;
+        }
+        stepTime = total / due;
+        count(wallDelta, due, stepTime);
+        return due;
+    }
+
+    void count(float wallDelta, int due, float stepTime) {
+        wallSeconds += wallDelta;
+        simulatedSeconds += due * stepTime;
+        frames++;
+        steps += due;
+    }
+
+    // Moves to the next scale up or down the list from the current one
+    void change(bool faster) {
+        int level = 0;
+        while (level < TIME_SCALE_COUNT - 1 && TIME_SCALES[level] < scale) level++;
+        if (faster && TIME_SCALES[level] <= scale) level = SDL_min(level + 1, TIME_SCALE_COUNT - 1);
+        if (!faster) level = SDL_max(level - 1, 0);
+        if (TIME_SCALES[level] == scale) return;
+        logStats();
+        scale = TIME_SCALES[level];
+        wallSeconds = simulatedSeconds = 0.0;
+        frames = steps = cappedFrames = 0;
+        accumulator = 0.0f;
+    }
+
+    void logStats() const {
+        if (frames == 0 || wallSeconds <= 0.0) return;
+        SDL_Log("Time scale %.2fx: %.2f simulated seconds per wall second over %.1f s, %.2f steps per frame, %.1f%% of frames hit the step cap",
+            scale, simulatedSeconds / wallSeconds, wallSeconds, (double)steps / frames, 100.0 * cappedFrames / frames);
+    }
+};
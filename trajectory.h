@@ -0,0 +1,237 @@
+#pragma once
+
+#include "physics.h"
+#include "replay.h"
+#include <SDL2/SDL.h>
+#include <math.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+const float CACHE_MARGIN = 1.0f; // World units past the screen edges that still quantize exactly
+
+// What a circle looks like, its position comes from the keyframes
+struct CachedBody
+{
+    Uint32 firstFrame; // First keyframe it is in
+    Uint8 radius;      // Pixels
+    Uint8 red, green, blue;
+};
+
+// Positions of every circle at a fixed rate, quantized to 16 bits per axis
+// over the screen plus CACHE_MARGIN, which is under a millimeter on a 1080p
+// screen and a quarter of the memory of float positions and velocities.
+// Circles are only ever added, so each keyframe holds the ones of the last
+// keyframe plus the new ones at the end.
+// One thread fills it while another plays it back. The writer finishes a
+// keyframe before publishing it through ready, and the keyframe list is
+// sized up front so it never moves under the reader. Bodies are added under
+// a lock, the reader only takes it when new ones show up
+struct TrajectoryCache
+{
+    static const Uint32 MAGIC = 0x43544F42; // "BOTC"
+    static const Uint16 VERSION = 1;
+    static const int HEADER_SIZE = 26;
+
+    Uint16 stepRate = 60;
+    Uint16 stepsPerFrame = 2; // Physics steps between keyframes
+    float width = 0.0f, height = 0.0f;
+    std::vector<std::vector<Uint16>> frames; // x and y of each body in turn
+    std::vector<CachedBody> bodies;
+    std::mutex bodyLock;
+    std::atomic<Uint32> ready;
+    std::atomic<bool> complete;
+
+    TrajectoryCache() : ready(0), complete(false) {}
+
+    void plan(Uint32 frameCount, Uint16 stepRate, Uint16 stepsPerFrame, float width, float height) {
+        frames.assign(frameCount, std::vector<Uint16>());
+        this->stepRate = stepRate;
+        this->stepsPerFrame = stepsPerFrame;
+        this->width = width;
+        this->height = height;
+        ready = 0;
+        complete = false;
+    }
+
+    float frameTime() const {
+        return (float)stepsPerFrame / stepRate;
+    }
+
+    void addBody(const CachedBody& body) {
+        std::lock_guard<std::mutex> guard(bodyLock);
+        bodies.push_back(body);
+    }
+    CachedBody body(int index) {
+        std::lock_guard<std::mutex> guard(bodyLock);
+        return bodies[index];
+    }
+
+    // Writer side, stores where bodies 0 to count - 1 are now as the next keyframe
+    void capture(const PhysicsWorld& world, int count) {
+        Uint32 frame = ready.load(std::memory_order_relaxed);
+        if (frame >= frames.size()) return;
+        std::vector<Uint16>& positions = frames[frame];
+        positions.resize(2 * count);
+        float scaleX = 65535.0f / (width + 2 * CACHE_MARGIN), scaleY = 65535.0f / (height + 2 * CACHE_MARGIN);
+        for (int i = 0; i < count; i++) {
+            b2Vec2 position = world.getPosition(i);
+            positions[2 * i] = (Uint16)(SDL_clamp(position.x + CACHE_MARGIN, 0.0f, width + 2 * CACHE_MARGIN) * scaleX + 0.5f);
+            positions[2 * i + 1] = (Uint16)(SDL_clamp(position.y + CACHE_MARGIN, 0.0f, height + 2 * CACHE_MARGIN) * scaleY + 0.5f);
+        }
+        ready.store(frame + 1, std::memory_order_release);
+    }
+
+    b2Vec2 position(Uint32 frame, int body) const {
+        const std::vector<Uint16>& positions = frames[frame];
+        return b2Vec2(positions[2 * body] * (width + 2 * CACHE_MARGIN) / 65535.0f - CACHE_MARGIN,
+                      positions[2 * body + 1] * (height + 2 * CACHE_MARGIN) / 65535.0f - CACHE_MARGIN);
+    }
+
+    // Only what is ready, the rest of a cache still being filled is left out.
+    // Keyframes are written as they are in memory, little endian like the snapshots
+    bool save(const char* path) {
+        SDL_RWops* file = SDL_RWFromFile(path, "wb");
+        if (!file) return false;
+        Uint32 frameCount = ready.load(std::memory_order_acquire);
+        std::lock_guard<std::mutex> guard(bodyLock);
+        SDL_WriteLE32(file, MAGIC);
+        SDL_WriteLE16(file, VERSION);
+        SDL_WriteLE16(file, stepRate);
+        SDL_WriteLE16(file, stepsPerFrame);
+        writeFloat(file, width);
+        writeFloat(file, height);
+        SDL_WriteLE32(file, (Uint32)bodies.size());
+        SDL_WriteLE32(file, frameCount);
+        for (const CachedBody& body : bodies) {
+            SDL_WriteLE32(file, body.firstFrame);
+            SDL_WriteU8(file, body.radius);
+            SDL_WriteU8(file, body.red);
+            SDL_WriteU8(file, body.green);
+            SDL_WriteU8(file, body.blue);
+        }
+        bool written = true;
+        for (Uint32 f = 0; f < frameCount && written; f++) {
+            const std::vector<Uint16>& positions = frames[f];
+            SDL_WriteLE32(file, (Uint32)positions.size() / 2);
+            if (!positions.empty()) written = SDL_RWwrite(file, positions.data(), sizeof(Uint16), positions.size()) == positions.size();
+        }
+        return SDL_RWclose(file) == 0 && written;
+    }
+
+    bool load(const char* path) {
+        SDL_RWops* file = SDL_RWFromFile(path, "rb");
+        if (!file) return false;
+        Uint32 magic = SDL_ReadLE32(file);
+        Uint16 version = SDL_ReadLE16(file);
+        if (magic != MAGIC || version != VERSION) {
+            SDL_SetError("%s is not a trajectory cache of version %d", path, VERSION);
+            SDL_RWclose(file);
+            return false;
+        }
+        Uint16 fileStepRate = SDL_ReadLE16(file);
+        Uint16 fileStepsPerFrame = SDL_ReadLE16(file);
+        float fileWidth = readFloat(file);
+        float fileHeight = readFloat(file);
+        Uint32 bodyCount = SDL_ReadLE32(file);
+        Uint32 frameCount = SDL_ReadLE32(file);
+        // Every body takes 8 bytes and every keyframe at least its count, so
+        // a file too short for the counts is cut off or corrupt
+        Sint64 expected = HEADER_SIZE + (Sint64)bodyCount * 8 + (Sint64)frameCount * 4;
+        if (fileStepRate == 0 || fileStepsPerFrame == 0 || SDL_RWsize(file) < expected) {
+            SDL_SetError("%s is not a valid trajectory cache", path);
+            SDL_RWclose(file);
+            return false;
+        }
+        plan(frameCount, fileStepRate, fileStepsPerFrame, fileWidth, fileHeight);
+        bodies.resize(bodyCount);
+        for (CachedBody& body : bodies) {
+            body.firstFrame = SDL_ReadLE32(file);
+            body.radius = SDL_ReadU8(file);
+            body.red = SDL_ReadU8(file);
+            body.green = SDL_ReadU8(file);
+            body.blue = SDL_ReadU8(file);
+        }
+        // Bodies are only ever added, the player relies on no keyframe having fewer than the last
+        Uint32 previous = 0;
+        for (std::vector<Uint16>& positions : frames) {
+            Uint32 count = SDL_ReadLE32(file);
+            if (count > bodyCount || count < previous) break;
+            previous = count;
+            positions.resize(2 * count);
+            if (count && SDL_RWread(file, positions.data(), sizeof(Uint16), positions.size()) != positions.size()) break;
+            ready++;
+        }
+        SDL_RWclose(file);
+        if (ready != frameCount) {
+            SDL_SetError("%s is cut off or corrupt after %u of %u keyframes", path, ready.load(), frameCount);
+            return false;
+        }
+        complete = true;
+        return true;
+    }
+
+    size_t bytes() const {
+        size_t total = bodies.size() * sizeof(CachedBody);
+        for (const std::vector<Uint16>& positions : frames) total += positions.size() * sizeof(Uint16);
+        return total;
+    }
+};
+
+// Plays a cache back by interpolating linearly between the two keyframes
+// around the playback time. It holds on the newest keyframe while the writer
+// is behind, and starts over once a complete cache runs out
+struct TrajectoryPlayer
+{
+    TrajectoryCache* cache;
+    double time = 0.0; // Simulated seconds since the first keyframe
+    Uint32 frame = 0;
+    float blend = 0.0f;
+    int count = 0;     // Bodies in the current keyframe
+
+    Uint64 frames = 0, stalls = 0, loops = 0;
+
+    explicit TrajectoryPlayer(TrajectoryCache* cache) : cache(cache) {}
+
+    void advance(float deltaTime) {
+        frames++;
+        time += deltaTime;
+        Uint32 ready = cache->ready.load(std::memory_order_acquire);
+        if (ready == 0) {
+            time = 0.0;
+            count = 0;
+            stalls++;
+            return;
+        }
+        double end = (ready - 1) * (double)cache->frameTime();
+        if (time > end) {
+            if (cache->complete.load() && end > 0.0) {
+                time = fmod(time, end);
+                loops++;
+            }
+            else {
+                time = end;
+                stalls++;
+            }
+        }
+        double position = time / cache->frameTime();
+        frame = SDL_min((Uint32)position, ready - 1);
+        blend = frame + 1 < ready ? (float)(position - frame) : 0.0f;
+        count = (int)cache->frames[frame].size() / 2;
+    }
+
+    // World units. Bodies added in the next keyframe only show up once it is reached
+    b2Vec2 position(int body) const {
+        b2Vec2 from = cache->position(frame, body);
+        if (blend == 0.0f) return from;
+        b2Vec2 to = cache->position(frame + 1, body);
+        return from + blend * (to - from);
+    }
+
+    void logStats() const {
+        if (frames == 0) return;
+        SDL_Log("Trajectory cache: %u keyframes ready%s, %.1f MB, %llu frames played, %llu waited for the simulation, %llu loops",
+            cache->ready.load(), cache->complete.load() ? " and complete" : "", cache->bytes() / 1048576.0,
+            (unsigned long long)frames, (unsigned long long)stalls, (unsigned long long)loops);
+    }
+};
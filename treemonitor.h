@@ -0,0 +1,117 @@
+#pragma once
+
+#include "physics.h"
+#include <SDL2/SDL.h>
+#include <vector>
+
+const int TREE_SAMPLE_STEPS = 30; // Walking the whole tree every step would cost more than it finds
+const int TREE_MAX_DEFER = 10;    // Samples a rebuild waits for an idle frame before it runs anyway
+
+struct TreeSample
+{
+    Uint32 step;
+    BroadphaseStats stats;
+    float stepMs;  // Average over the steps since the last sample
+    bool rebuilt;  // The tree was rebuilt since the last sample
+};
+
+// Samples the shape of the broadphase tree as the crowd moves and keeps the
+// series for export. Quality creeps up as proxies move around, so once it
+// gets past degradation times the quality of a fresh tree a rebuild is
+// queued. It runs on the next frame with enough time left over, or after
+// TREE_MAX_DEFER samples without one. A baseline from a crowd of another
+// size says nothing, so it is taken again when the proxy count changes by a
+// tenth
+struct TreeMonitor
+{
+    float degradation; // 0 only watches
+    Uint32 steps = 0;
+    int stepsSinceSample = 0;
+    double stepMsSinceSample = 0.0;
+    float baseline = 0.0f;
+    int baselineProxies = 0;
+    bool pending = false, rebuiltSinceSample = false;
+    int deferred = 0;
+    float lastRebuildMs = 0.0f;
+    std::vector<TreeSample> samples;
+
+    Uint64 rebuilds = 0, forced = 0;
+    double rebuildMs = 0.0;
+    float qualityGained = 0.0f;
+
+    explicit TreeMonitor(float degradation) : degradation(degradation) {}
+
+    void afterStep(PhysicsWorld& world, float stepMs) {
+        steps++;
+        stepsSinceSample++;
+        stepMsSinceSample += stepMs;
+        if (steps % TREE_SAMPLE_STEPS != 0) return;
+
+        BroadphaseStats stats = world.getBroadphaseStats();
+        samples.push_back({ steps, stats, (float)(stepMsSinceSample / stepsSinceSample), rebuiltSinceSample });
+        stepsSinceSample = 0;
+        stepMsSinceSample = 0.0;
+        rebuiltSinceSample = false;
+        if (stats.quality <= 0.0f) return;
+
+        if (SDL_abs(stats.proxies - baselineProxies) * 10 > baselineProxies) {
+            baseline = stats.quality;
+            baselineProxies = stats.proxies;
+        }
+        if (degradation > 0.0f && stats.quality > degradation * baseline) pending = true;
+        if (pending && ++deferred > TREE_MAX_DEFER) {
+            forced++;
+            rebuild(world);
+        }
+    }
+
+    // spareMs is what is left of the frame after stepping and drawing
+    void idle(PhysicsWorld& world, float spareMs) {
+        if (pending && lastRebuildMs <= spareMs) rebuild(world);
+    }
+
+    void rebuild(PhysicsWorld& world) {
+        float before = world.getBroadphaseStats().quality;
+        Uint64 start = SDL_GetPerformanceCounter();
+        world.rebuildBroadphase();
+        lastRebuildMs = (float)((SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+        BroadphaseStats stats = world.getBroadphaseStats();
+        baseline = stats.quality;
+        baselineProxies = stats.proxies;
+        pending = false;
+        deferred = 0;
+        rebuiltSinceSample = true;
+        rebuilds++;
+        rebuildMs += lastRebuildMs;
+        qualityGained += before - stats.quality;
+    }
+
+    // One row per sample, run tells series from different runs apart in one file
+    static void writeCsvHeader(SDL_RWops* file) {
+        const char header[] = "run,step,height,balance,quality,proxies,step_ms,rebuilt\n";
+        SDL_RWwrite(file, header, 1, sizeof(header) - 1);
+    }
+    void writeCsv(SDL_RWops* file, const char* run) const {
+        char line[256];
+        for (const TreeSample& sample : samples) {
+            int length = SDL_snprintf(line, sizeof(line), "%s,%u,%d,%d,%.4f,%d,%.4f,%d\n", run, sample.step, sample.stats.height,
+                sample.stats.balance, sample.stats.quality, sample.stats.proxies, sample.stepMs, sample.rebuilt ? 1 : 0);
+            SDL_RWwrite(file, line, 1, SDL_min(length, (int)sizeof(line) - 1));
+        }
+    }
+    bool save(const char* path, const char* run) const {
+        SDL_RWops* file = SDL_RWFromFile(path, "wb");
+        if (!file) return false;
+        writeCsvHeader(file);
+        writeCsv(file, run);
+        return SDL_RWclose(file) == 0;
+    }
+
+    void logStats() const {
+        if (samples.empty()) return;
+        const TreeSample& last = samples.back();
+        SDL_Log("Broadphase tree: height %d, balance %d, quality %.2f over %d proxies at the end, %llu rebuilds (%llu forced), %.3f ms each, %.2f quality gained on average",
+            last.stats.height, last.stats.balance, last.stats.quality, last.stats.proxies, (unsigned long long)rebuilds, (unsigned long long)forced,
+            rebuilds ? rebuildMs / rebuilds : 0.0, rebuilds ? qualityGained / rebuilds : 0.0f);
+    }
+};